@@ -42,6 +42,16 @@ android {
 			)
 			isMinifyEnabled = true
 			isShrinkResources = true
+			// Profile-guided optimisation is opt in, with a profile written by
+			// src/main/cpp/pgo/train.sh, e.g.
+			// -Pgbcc.pgoProfile=src/main/cpp/pgo/default.profdata
+			(project.findProperty("gbcc.pgoProfile") as String?)?.let { profile ->
+				externalNativeBuild {
+					cmake {
+						arguments += listOf("-DGBCC_PGO=USE", "-DGBCC_PROFILE=${file(profile).absolutePath}")
+					}
+				}
+			}
 		}
 		debug {
 			isMinifyEnabled = false
@@ -2,6 +2,19 @@
 	<init>();
 }
 
+# Called from native code
+-keepclassmembers class com.philj56.gbcc.GLActivity {
+	void onEmulatorEvents(int);
+}
+-keep class com.philj56.gbcc.main.RomInfo {
+	<init>(java.lang.String, java.lang.String, boolean, boolean, boolean, int, int, int);
+}
+
+# Not called from the app itself, but kept for instrumentation & debugging
+-keepclassmembers class com.philj56.gbcc.GLActivity {
+	long[] getFrameMetrics();
+}
+
 #-dontobfuscate
 
 # For readable stack traces
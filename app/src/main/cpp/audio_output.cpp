@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#include "audio_output.h"
+#include "audio_stream.h"
+#include "emulator.h"
+#include "frame_metrics.h"
+#include "logger.h"
+#include "recorder.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+
+extern "C" {
+#include <audio.h>
+}
+
+/* Buffers handed to the device at once */
+#define DEVICE_BUFFERS 2
+/* Ring size & target fill, in core buffers */
+#define STREAM_BUFFERS 8
+#define TARGET_BUFFERS 2
+
+static SLObjectItf engine_object;
+static SLObjectItf output_mix;
+static SLObjectItf player_object;
+static SLAndroidSimpleBufferQueueItf buffer_queue;
+
+static struct audio_stream stream;
+static unsigned int buffer_frames;
+static unsigned int stream_rate;
+static double buffer_seconds;
+static int16_t *device_buffers[DEVICE_BUFFERS];
+static unsigned int next_buffer;  /* Callback only */
+
+static std::atomic<const struct gbcc_audio *> owner;
+static bool device_open;
+static struct audio_output_stats last_stats;
+
+/* OpenSL's own thread, whenever the device has finished with a buffer */
+static void buffer_done(SLAndroidSimpleBufferQueueItf queue, void *context) {
+	(void) context;
+	int16_t *buffer = device_buffers[next_buffer];
+	next_buffer = (next_buffer + 1) % DEVICE_BUFFERS;
+	frame_metrics_record(FRAME_METRIC_AUDIO_FILL, audio_stream_fill(&stream) * UINT64_C(1000000) / stream_rate);
+	audio_stream_read(&stream, buffer, buffer_frames);
+	(*queue)->Enqueue(queue, buffer, buffer_frames * AUDIO_CHANNELS * sizeof(*buffer));
+}
+
+static void close_device() {
+	if (player_object != nullptr) {
+		// Destroy waits for any callback in progress to return
+		(*player_object)->Destroy(player_object);
+		player_object = nullptr;
+		buffer_queue = nullptr;
+	}
+	if (output_mix != nullptr) {
+		(*output_mix)->Destroy(output_mix);
+		output_mix = nullptr;
+	}
+	if (engine_object != nullptr) {
+		(*engine_object)->Destroy(engine_object);
+		engine_object = nullptr;
+	}
+}
+
+static bool open_device(unsigned int sample_rate) {
+	SLEngineItf engine;
+	if (slCreateEngine(&engine_object, 0, nullptr, 0, nullptr, nullptr) != SL_RESULT_SUCCESS
+			|| (*engine_object)->Realize(engine_object, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS
+			|| (*engine_object)->GetInterface(engine_object, SL_IID_ENGINE, &engine) != SL_RESULT_SUCCESS
+			|| (*engine)->CreateOutputMix(engine, &output_mix, 0, nullptr, nullptr) != SL_RESULT_SUCCESS
+			|| (*output_mix)->Realize(output_mix, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS) {
+		return false;
+	}
+
+	SLDataLocator_AndroidSimpleBufferQueue queue_locator = {
+		SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE,
+		DEVICE_BUFFERS
+	};
+	SLDataFormat_PCM format = {
+		SL_DATAFORMAT_PCM,
+		AUDIO_CHANNELS,
+		sample_rate * 1000,  // In milliHertz
+		SL_PCMSAMPLEFORMAT_FIXED_16,
+		SL_PCMSAMPLEFORMAT_FIXED_16,
+		SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT,
+		SL_BYTEORDER_LITTLEENDIAN
+	};
+	SLDataSource source = {&queue_locator, &format};
+	SLDataLocator_OutputMix mix_locator = {SL_DATALOCATOR_OUTPUTMIX, output_mix};
+	SLDataSink sink = {&mix_locator, nullptr};
+	const SLInterfaceID ids[] = {SL_IID_ANDROIDSIMPLEBUFFERQUEUE};
+	const SLboolean required[] = {SL_BOOLEAN_TRUE};
+
+	SLPlayItf player;
+	if ((*engine)->CreateAudioPlayer(engine, &player_object, &source, &sink, 1, ids, required) != SL_RESULT_SUCCESS
+			|| (*player_object)->Realize(player_object, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS
+			|| (*player_object)->GetInterface(player_object, SL_IID_PLAY, &player) != SL_RESULT_SUCCESS
+			|| (*player_object)->GetInterface(player_object, SL_IID_ANDROIDSIMPLEBUFFERQUEUE, &buffer_queue) != SL_RESULT_SUCCESS
+			|| (*buffer_queue)->RegisterCallback(buffer_queue, buffer_done, nullptr) != SL_RESULT_SUCCESS) {
+		return false;
+	}
+
+	// Start with silence in every buffer; the callback takes it from there
+	next_buffer = 0;
+	for (int16_t *buffer : device_buffers) {
+		(*buffer_queue)->Enqueue(buffer_queue, buffer, buffer_frames * AUDIO_CHANNELS * sizeof(*buffer));
+	}
+	return (*player)->SetPlayState(player, SL_PLAYSTATE_PLAYING) == SL_RESULT_SUCCESS;
+}
+
+bool audio_output_begin(unsigned int sample_rate, unsigned int frames_per_buffer) {
+	if (device_open) {
+		return true;
+	}
+	buffer_frames = frames_per_buffer;
+	stream_rate = sample_rate;
+	buffer_seconds = static_cast<double>(frames_per_buffer) / sample_rate;
+	if (!audio_stream_initialise(&stream, sample_rate, sample_rate,
+				STREAM_BUFFERS * frames_per_buffer, TARGET_BUFFERS * frames_per_buffer)) {
+		return false;
+	}
+	for (int16_t *&buffer : device_buffers) {
+		buffer = static_cast<int16_t *>(calloc(frames_per_buffer * AUDIO_CHANNELS, sizeof(*buffer)));
+	}
+	device_open = device_buffers[0] != nullptr && device_buffers[1] != nullptr && open_device(sample_rate);
+	if (!device_open) {
+		logger_print(LOGGER_ERROR, "Failed to open the audio device");
+		close_device();
+		for (int16_t *&buffer : device_buffers) {
+			free(buffer);
+			buffer = nullptr;
+		}
+		audio_stream_destroy(&stream);
+	}
+	return device_open;
+}
+
+void audio_output_end() {
+	if (!device_open) {
+		return;
+	}
+	close_device();
+	last_stats = audio_output_get_stats();
+	device_open = false;
+	for (int16_t *&buffer : device_buffers) {
+		free(buffer);
+		buffer = nullptr;
+	}
+	audio_stream_destroy(&stream);
+}
+
+struct audio_output_stats audio_output_get_stats() {
+	if (!device_open) {
+		return last_stats;
+	}
+	struct audio_output_stats stats{};
+	stats.frames_written = stream.frames_written.load();
+	stats.frames_read = stream.frames_read.load();
+	stats.overrun_frames = stream.overrun_frames.load();
+	stats.underrun_frames = stream.underrun_frames.load();
+	stats.ratio_ppm = stream.ratio_ppm.load();
+	return stats;
+}
+
+unsigned int audio_output_sample_rate() {
+	return stream_rate;
+}
+
+/* The core's platform hooks, which audio_platform/opensl.c would otherwise provide */
+
+extern "C" void gbcc_audio_platform_initialise(struct gbcc_audio *audio) {
+	const struct gbcc_audio *expected = nullptr;
+	owner.compare_exchange_strong(expected, audio);
+}
+
+extern "C" void gbcc_audio_platform_destroy(struct gbcc_audio *audio) {
+	const struct gbcc_audio *expected = audio;
+	owner.compare_exchange_strong(expected, nullptr);
+}
+
+/* Emulation thread, each time the core has mixed a full buffer */
+extern "C" void gbcc_audio_platform_queue_buffer(struct gbcc_audio *audio) {
+	// Without sync to video, this is how the emulator finds frame boundaries
+	struct emulator *emu = emulator_current();
+	if (emu != nullptr) {
+		emulator_advance(emu, buffer_seconds);
+	}
+	if (owner.load(std::memory_order_relaxed) != audio) {
+		return;
+	}
+	recorder_push_audio(audio->mix_buffer, buffer_frames);
+	if (device_open) {
+		audio_stream_write(&stream, audio->mix_buffer, buffer_frames);
+	}
+}
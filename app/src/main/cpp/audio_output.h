@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_AUDIO_OUTPUT_H
+#define GBCC_ANDROID_AUDIO_OUTPUT_H
+
+#include <cstdint>
+
+/*
+ * The app's audio backend, in place of the core's audio_platform/opensl.c.
+ *
+ * The core's gbcc_audio_platform_queue_buffer hook, on the emulation
+ * thread, writes each mixed buffer into an audio_stream, and an OpenSL ES
+ * buffer queue callback pulls device buffers back out through the stream's
+ * resampler. Dynamic rate control then keeps the ring near its target fill,
+ * so the emulated and device clocks can drift apart without crackle. Each
+ * buffer also goes to the recorder, which ignores it unless recording.
+ *
+ * There's one audio device, so this is a process singleton: it plays
+ * whichever emulator initialised its core audio first, and the rest are
+ * silent.
+ */
+
+struct audio_output_stats {
+	uint64_t frames_written;
+	uint64_t frames_read;
+	uint64_t overrun_frames;
+	uint64_t underrun_frames;
+	uint32_t ratio_ppm;
+};
+
+/*
+ * Open the device. Must be called before gbcc_audio_initialise, with the
+ * same rate & buffer size, as the core queues buffers of frames_per_buffer
+ * interleaved stereo frames.
+ */
+bool audio_output_begin(unsigned int sample_rate, unsigned int frames_per_buffer);
+
+/* Close the device, once the emulation thread has stopped */
+void audio_output_end();
+
+struct audio_output_stats audio_output_get_stats();
+
+/* The rate the core mixes at, as last given to audio_output_begin */
+unsigned int audio_output_sample_rate();
+
+#endif /* GBCC_ANDROID_AUDIO_OUTPUT_H */
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#include "audio_sink.h"
+#include "audio_stream.h"
+
+#include <cstdio>
+#include <cstring>
+
+#define WAV_HEADER_SIZE 44
+#define WAV_BITS 16
+
+static void null_write(struct audio_sink *sink, const int16_t *frames, size_t count) {
+	(void) sink;
+	(void) frames;
+	(void) count;
+}
+
+static void null_close(struct audio_sink *sink) {
+	(void) sink;
+}
+
+void audio_sink_null(struct audio_sink *sink) {
+	sink->write = null_write;
+	sink->close = null_close;
+	sink->data = nullptr;
+}
+
+static void put_le16(uint8_t *p, uint16_t v) {
+	p[0] = static_cast<uint8_t>(v);
+	p[1] = static_cast<uint8_t>(v >> 8u);
+}
+
+static void put_le32(uint8_t *p, uint32_t v) {
+	put_le16(p, static_cast<uint16_t>(v));
+	put_le16(p + 2, static_cast<uint16_t>(v >> 16u));
+}
+
+static void write_wav_header(FILE *fp, unsigned int sample_rate, uint32_t data_bytes) {
+	const uint16_t block_align = AUDIO_CHANNELS * WAV_BITS / 8;
+	uint8_t h[WAV_HEADER_SIZE];
+	memcpy(&h[0], "RIFF", 4);
+	put_le32(&h[4], 36 + data_bytes);
+	memcpy(&h[8], "WAVEfmt ", 8);
+	put_le32(&h[16], 16);
+	put_le16(&h[20], 1);  /* PCM */
+	put_le16(&h[22], AUDIO_CHANNELS);
+	put_le32(&h[24], sample_rate);
+	put_le32(&h[28], sample_rate * block_align);
+	put_le16(&h[32], block_align);
+	put_le16(&h[34], WAV_BITS);
+	memcpy(&h[36], "data", 4);
+	put_le32(&h[40], data_bytes);
+	fseek(fp, 0, SEEK_SET);
+	fwrite(h, sizeof(h), 1, fp);
+}
+
+struct wav_sink {
+	FILE *fp;
+	unsigned int sample_rate;
+	uint32_t data_bytes;
+};
+
+static void wav_write(struct audio_sink *sink, const int16_t *frames, size_t count) {
+	auto *wav = static_cast<struct wav_sink *>(sink->data);
+	/* WAV data is little-endian, as is everything we run on */
+	size_t written = fwrite(frames, AUDIO_CHANNELS * sizeof(*frames), count, wav->fp);
+	wav->data_bytes += static_cast<uint32_t>(written * AUDIO_CHANNELS * sizeof(*frames));
+}
+
+static void wav_close(struct audio_sink *sink) {
+	auto *wav = static_cast<struct wav_sink *>(sink->data);
+	write_wav_header(wav->fp, wav->sample_rate, wav->data_bytes);
+	fclose(wav->fp);
+	delete wav;
+	sink->data = nullptr;
+}
+
+bool audio_sink_wav(struct audio_sink *sink, const char *filename, unsigned int sample_rate) {
+	FILE *fp = fopen(filename, "wb");
+	if (fp == nullptr) {
+		return false;
+	}
+	/* Placeholder sizes until close */
+	write_wav_header(fp, sample_rate, 0);
+	sink->write = wav_write;
+	sink->close = wav_close;
+	sink->data = new wav_sink{fp, sample_rate, 0};
+	return true;
+}
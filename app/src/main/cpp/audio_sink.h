@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_AUDIO_SINK_H
+#define GBCC_ANDROID_AUDIO_SINK_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Destination for device-rate audio read from an audio_stream.
+ *
+ * Whatever drives the device clock (an OpenSL ES buffer callback, or a timer
+ * when running headless) reads a period from the stream and hands it here.
+ */
+struct audio_sink {
+	void (*write)(struct audio_sink *sink, const int16_t *frames, size_t count);
+	void (*close)(struct audio_sink *sink);
+	void *data;
+};
+
+/* Discards everything, for measuring buffer behaviour on its own */
+void audio_sink_null(struct audio_sink *sink);
+
+/* Writes 16-bit stereo PCM to a WAV file, finalising the header on close */
+bool audio_sink_wav(struct audio_sink *sink, const char *filename, unsigned int sample_rate);
+
+static inline void audio_sink_write(struct audio_sink *sink, const int16_t *frames, size_t count) {
+	sink->write(sink, frames, count);
+}
+
+static inline void audio_sink_close(struct audio_sink *sink) {
+	sink->close(sink);
+}
+
+#endif /* GBCC_ANDROID_AUDIO_SINK_H */
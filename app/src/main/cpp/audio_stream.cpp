@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#include "audio_stream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+/* Largest deviation from the nominal ratio, about 17 cents at the extreme */
+#define DEFAULT_MAX_ADJUST 0.01
+/*
+ * Fill level controller gains, per read. The proportional part soaks up
+ * jitter, and the integral part settles on the clocks' actual drift so the
+ * fill level returns to its target rather than sitting off to one side.
+ */
+#define PROPORTIONAL_GAIN 0.01
+#define INTEGRAL_GAIN 0.00002
+/* Per-read smoothing of the fill level, so the ratio doesn't follow jitter */
+#define FILL_SMOOTHING 0.05
+/* Passband edge, as a fraction of the lower of the two Nyquist frequencies */
+#define CUTOFF 0.9
+
+static size_t round_up_pow2(size_t x) {
+	size_t n = 1;
+	while (n < x) {
+		n <<= 1u;
+	}
+	return n;
+}
+
+/*
+ * Blackman-windowed sinc, tabulated at AUDIO_RESAMPLER_PHASES + 1 fractional
+ * offsets so the last row can be interpolated towards. Tap k of row p
+ * weights the input k - (HALF_TAPS - 1) frames from the current one, for an
+ * output p / PHASES of the way to the next.
+ */
+static void build_filter(struct audio_stream *stream) {
+	const double half = AUDIO_RESAMPLER_HALF_TAPS;
+	double fc = 0.5 * CUTOFF * std::min(1.0, 1.0 / stream->base_step);
+	for (int p = 0; p <= AUDIO_RESAMPLER_PHASES; p++) {
+		double frac = static_cast<double>(p) / AUDIO_RESAMPLER_PHASES;
+		double taps[AUDIO_RESAMPLER_TAPS];
+		double sum = 0;
+		for (int k = 0; k < AUDIO_RESAMPLER_TAPS; k++) {
+			double x = (k - (half - 1)) - frac;
+			double sinc = (x == 0) ? 1 : sin(2 * M_PI * fc * x) / (2 * M_PI * fc * x);
+			double n = (x + half) / (2 * half);
+			double window = 0.42 - 0.5 * cos(2 * M_PI * n) + 0.08 * cos(4 * M_PI * n);
+			taps[k] = sinc * window;
+			sum += taps[k];
+		}
+		for (int k = 0; k < AUDIO_RESAMPLER_TAPS; k++) {
+			stream->filter[p][k] = static_cast<float>(taps[k] / sum);
+		}
+	}
+}
+
+bool audio_stream_initialise(struct audio_stream *stream, unsigned int in_rate, unsigned int out_rate,
+		size_t capacity, size_t target_fill) {
+	stream->capacity = round_up_pow2(capacity);
+	stream->ring = static_cast<int16_t *>(calloc(stream->capacity * AUDIO_CHANNELS, sizeof(*stream->ring)));
+	if (stream->ring == nullptr) {
+		return false;
+	}
+	stream->head.store(0);
+	stream->tail.store(0);
+
+	stream->base_step = static_cast<double>(in_rate) / out_rate;
+	stream->step = stream->base_step;
+	stream->position = 0;
+	stream->target_fill = std::min(std::max<size_t>(target_fill, 1), stream->capacity);
+	stream->fill_average = static_cast<double>(stream->target_fill);
+	stream->max_adjust = DEFAULT_MAX_ADJUST;
+	stream->drift = 0;
+	stream->drc = true;
+	memset(stream->history, 0, sizeof(stream->history));
+	stream->history_index = 0;
+	build_filter(stream);
+
+	stream->frames_written.store(0);
+	stream->frames_read.store(0);
+	stream->overrun_frames.store(0);
+	stream->underrun_frames.store(0);
+	stream->ratio_ppm.store(1000000);
+	return true;
+}
+
+void audio_stream_destroy(struct audio_stream *stream) {
+	free(stream->ring);
+	stream->ring = nullptr;
+}
+
+void audio_stream_set_drc(struct audio_stream *stream, bool enabled) {
+	stream->drc = enabled;
+}
+
+size_t audio_stream_fill(const struct audio_stream *stream) {
+	return stream->head.load(std::memory_order_acquire) - stream->tail.load(std::memory_order_acquire);
+}
+
+size_t audio_stream_write(struct audio_stream *stream, const int16_t *frames, size_t count) {
+	size_t head = stream->head.load(std::memory_order_relaxed);
+	size_t tail = stream->tail.load(std::memory_order_acquire);
+	size_t n = std::min(count, stream->capacity - (head - tail));
+
+	size_t mask = stream->capacity - 1;
+	size_t first = std::min(n, stream->capacity - (head & mask));
+	memcpy(&stream->ring[(head & mask) * AUDIO_CHANNELS], frames, first * AUDIO_CHANNELS * sizeof(*frames));
+	memcpy(stream->ring, &frames[first * AUDIO_CHANNELS], (n - first) * AUDIO_CHANNELS * sizeof(*frames));
+
+	stream->head.store(head + n, std::memory_order_release);
+	stream->frames_written.fetch_add(n, std::memory_order_relaxed);
+	if (n < count) {
+		stream->overrun_frames.fetch_add(count - n, std::memory_order_relaxed);
+	}
+	return n;
+}
+
+/* Shift one input frame into the resampler's history, doubled up so the window is contiguous */
+static inline void push_history(struct audio_stream *stream, const int16_t *frame) {
+	unsigned int i = stream->history_index;
+	for (int ch = 0; ch < AUDIO_CHANNELS; ch++) {
+		float v = frame[ch];
+		stream->history[ch][i] = v;
+		stream->history[ch][i + AUDIO_RESAMPLER_TAPS] = v;
+	}
+	stream->history_index = (i + 1) % AUDIO_RESAMPLER_TAPS;
+}
+
+void audio_stream_read(struct audio_stream *stream, int16_t *out, size_t count) {
+	size_t head = stream->head.load(std::memory_order_acquire);
+	size_t tail = stream->tail.load(std::memory_order_relaxed);
+	size_t mask = stream->capacity - 1;
+
+	if (stream->drc) {
+		double fill = static_cast<double>(head - tail);
+		stream->fill_average += (fill - stream->fill_average) * FILL_SMOOTHING;
+		double target = static_cast<double>(stream->target_fill);
+		double error = std::min(1.0, std::max(-1.0, (stream->fill_average - target) / target));
+		double limit = stream->max_adjust;
+		stream->drift = std::min(limit, std::max(-limit, stream->drift + INTEGRAL_GAIN * error));
+		double adjust = std::min(limit, std::max(-limit, stream->drift + PROPORTIONAL_GAIN * error));
+		stream->step = stream->base_step * (1 + adjust);
+	} else {
+		stream->step = stream->base_step;
+	}
+	stream->ratio_ppm.store(static_cast<uint32_t>(lround(1e6 * stream->step / stream->base_step)),
+			std::memory_order_relaxed);
+
+	static const int16_t silence[AUDIO_CHANNELS] = {0};
+	uint64_t underruns = 0;
+	for (size_t i = 0; i < count; i++) {
+		bool starved = false;
+		while (stream->position >= 1.0) {
+			if (tail != head) {
+				push_history(stream, &stream->ring[(tail & mask) * AUDIO_CHANNELS]);
+				tail++;
+			} else {
+				push_history(stream, silence);
+				starved = true;
+			}
+			stream->position -= 1.0;
+		}
+		underruns += starved;
+
+		double phase = stream->position * AUDIO_RESAMPLER_PHASES;
+		int p = static_cast<int>(phase);
+		auto t = static_cast<float>(phase - p);
+		const float *f0 = stream->filter[p];
+		const float *f1 = stream->filter[p + 1];
+		for (int ch = 0; ch < AUDIO_CHANNELS; ch++) {
+			const float *h = &stream->history[ch][stream->history_index];
+			float acc = 0;
+			for (int k = 0; k < AUDIO_RESAMPLER_TAPS; k++) {
+				acc += h[k] * (f0[k] + t * (f1[k] - f0[k]));
+			}
+			acc = std::min(32767.0f, std::max(-32768.0f, acc));
+			out[i * AUDIO_CHANNELS + ch] = static_cast<int16_t>(lrintf(acc));
+		}
+		stream->position += stream->step;
+	}
+
+	stream->tail.store(tail, std::memory_order_release);
+	stream->frames_read.fetch_add(count, std::memory_order_relaxed);
+	if (underruns > 0) {
+		stream->underrun_frames.fetch_add(underruns, std::memory_order_relaxed);
+	}
+}
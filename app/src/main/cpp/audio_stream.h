@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_AUDIO_STREAM_H
+#define GBCC_ANDROID_AUDIO_STREAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#define AUDIO_CHANNELS 2
+#define AUDIO_RESAMPLER_HALF_TAPS 8
+#define AUDIO_RESAMPLER_TAPS (2 * AUDIO_RESAMPLER_HALF_TAPS)
+#define AUDIO_RESAMPLER_PHASES 64
+
+/*
+ * Stereo int16 stream from the emulator to the audio device.
+ *
+ * The emulation thread writes into a lock-free single-producer,
+ * single-consumer ring, and the device side reads from it through a
+ * windowed-sinc resampler. The resampling ratio is nudged continuously
+ * (by at most max_adjust) to hold the ring at its target fill level, so
+ * drift between the emulated and device clocks is absorbed without ever
+ * under- or overrunning, and the ring can be kept small.
+ */
+struct audio_stream {
+	/* Ring of interleaved frames, written by the producer only at head */
+	int16_t *ring;
+	size_t capacity;  /* Frames, a power of two */
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+
+	/* Consumer-only resampler state */
+	double base_step;   /* Input frames per output frame, nominally */
+	double step;
+	double position;    /* Fractional input position within the window */
+	double fill_average;
+	size_t target_fill;
+	double max_adjust;
+	double drift;       /* Integral term, the estimated relative clock drift */
+	bool drc;
+	float history[AUDIO_CHANNELS][2 * AUDIO_RESAMPLER_TAPS];
+	unsigned int history_index;
+	float filter[AUDIO_RESAMPLER_PHASES + 1][AUDIO_RESAMPLER_TAPS];
+
+	/* Statistics, readable from any thread */
+	std::atomic<uint64_t> frames_written;
+	std::atomic<uint64_t> frames_read;
+	std::atomic<uint64_t> overrun_frames;   /* Dropped because the ring was full */
+	std::atomic<uint64_t> underrun_frames;  /* Output while the ring was empty */
+	std::atomic<uint32_t> ratio_ppm;        /* Current step / base_step, in ppm */
+};
+
+/* target_fill is in frames, and capacity is rounded up to a power of two */
+bool audio_stream_initialise(struct audio_stream *stream, unsigned int in_rate, unsigned int out_rate,
+		size_t capacity, size_t target_fill);
+void audio_stream_destroy(struct audio_stream *stream);
+
+/* Enable or disable dynamic rate control, which is on by default */
+void audio_stream_set_drc(struct audio_stream *stream, bool enabled);
+
+/* Producer: returns the number of frames accepted */
+size_t audio_stream_write(struct audio_stream *stream, const int16_t *frames, size_t count);
+
+/* Consumer: always produces count frames, padding with silence on underrun */
+void audio_stream_read(struct audio_stream *stream, int16_t *out, size_t count);
+
+/* Frames currently buffered, from either side */
+size_t audio_stream_fill(const struct audio_stream *stream);
+
+#endif /* GBCC_ANDROID_AUDIO_STREAM_H */
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ * Audio stream microbenchmark. Simulates an emulator producing a frame's
+ * worth of samples at a time, with jitter and a clock that drifts from the
+ * device's, against a device pulling small fixed periods, all in virtual
+ * time. Reports how the ring's fill level behaves with and without dynamic
+ * rate control, and what the resampler costs.
+ */
+
+#include "bench.h"
+#include "../audio_sink.h"
+#include "../audio_stream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#define SAMPLE_RATE 48000u
+#define CHUNK_FRAMES (SAMPLE_RATE / 60)
+#define PERIOD_FRAMES 256u
+#define RING_FRAMES 4096u
+#define TARGET_FILL 1024u
+#define JITTER_SECONDS 0.002
+#define SIMULATED_SECONDS 60
+#define TONE_HZ 440.0
+
+static const double skews[] = {-0.005, -0.002, 0, 0.002, 0.0045};
+
+struct run_result {
+	uint64_t underruns;
+	uint64_t overruns;
+	size_t min_fill;
+	size_t max_fill;
+	double mean_fill;
+	uint32_t ratio_ppm;
+};
+
+static double now() {
+	struct timespec ts{};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool simulate(double skew, bool drc, struct audio_sink *sink, struct run_result *result) {
+	struct audio_stream stream;
+	if (!audio_stream_initialise(&stream, SAMPLE_RATE, SAMPLE_RATE, RING_FRAMES, TARGET_FILL)) {
+		return false;
+	}
+	audio_stream_set_drc(&stream, drc);
+
+	static int16_t chunk[CHUNK_FRAMES * AUDIO_CHANNELS];
+	static int16_t period[PERIOD_FRAMES * AUDIO_CHANNELS];
+	double chunk_interval = CHUNK_FRAMES / (SAMPLE_RATE * (1 + skew));
+	double period_interval = static_cast<double>(PERIOD_FRAMES) / SAMPLE_RATE;
+	double next_chunk = 0;
+	double next_period = -1;
+	uint64_t chunks = 0;
+	uint64_t tone_index = 0;
+	unsigned int seed = 1;
+
+	*result = {};
+	result->min_fill = RING_FRAMES;
+	uint64_t periods = 0;
+	double t = 0;
+	while (t < SIMULATED_SECONDS) {
+		if (next_chunk <= next_period || next_period < 0) {
+			t = next_chunk;
+			for (unsigned int i = 0; i < CHUNK_FRAMES; i++) {
+				auto v = static_cast<int16_t>(8000 * sin(2 * M_PI * TONE_HZ * tone_index++ / SAMPLE_RATE));
+				chunk[2 * i] = v;
+				chunk[2 * i + 1] = v;
+			}
+			audio_stream_write(&stream, chunk, CHUNK_FRAMES);
+			// Jittered around a steady schedule, as frames are paced by vsync
+			double jitter = JITTER_SECONDS * (rand_r(&seed) / static_cast<double>(RAND_MAX) - 0.5);
+			next_chunk = std::max(t, ++chunks * chunk_interval + jitter);
+			// The device starts once the ring is primed to its target
+			if (next_period < 0 && audio_stream_fill(&stream) >= TARGET_FILL) {
+				next_period = t;
+			}
+		} else {
+			t = next_period;
+			size_t fill = audio_stream_fill(&stream);
+			result->min_fill = std::min(result->min_fill, fill);
+			result->max_fill = std::max(result->max_fill, fill);
+			result->mean_fill += fill;
+			periods++;
+			audio_stream_read(&stream, period, PERIOD_FRAMES);
+			audio_sink_write(sink, period, PERIOD_FRAMES);
+			next_period += period_interval;
+		}
+	}
+
+	result->mean_fill /= std::max<uint64_t>(periods, 1);
+	result->underruns = stream.underrun_frames.load();
+	result->overruns = stream.overrun_frames.load();
+	result->ratio_ppm = stream.ratio_ppm.load();
+	audio_stream_destroy(&stream);
+	return true;
+}
+
+/* Resampler cost alone, with the ring kept topped up */
+static double resampler_ns_per_frame() {
+	struct audio_stream stream;
+	if (!audio_stream_initialise(&stream, SAMPLE_RATE, SAMPLE_RATE, RING_FRAMES, TARGET_FILL)) {
+		return 0;
+	}
+	static int16_t buffer[PERIOD_FRAMES * AUDIO_CHANNELS];
+	uint64_t frames = 0;
+	double start = now();
+	double elapsed;
+	do {
+		for (int i = 0; i < 1000; i++) {
+			audio_stream_write(&stream, buffer, PERIOD_FRAMES);
+			audio_stream_read(&stream, buffer, PERIOD_FRAMES);
+		}
+		frames += 1000 * PERIOD_FRAMES;
+		elapsed = now() - start;
+	} while (elapsed < 0.2);
+	audio_stream_destroy(&stream);
+	return 1e9 * elapsed / frames;
+}
+
+int audio_benchmark(const char *wav_file) {
+	struct audio_sink null_sink;
+	audio_sink_null(&null_sink);
+
+	printf("%d Hz, %u frame periods, %u frame target (%.1f ms), %d s simulated\n\n",
+			SAMPLE_RATE, PERIOD_FRAMES, TARGET_FILL, 1000.0 * TARGET_FILL / SAMPLE_RATE, SIMULATED_SECONDS);
+	printf("%8s %4s %10s %10s %8s %8s %8s %10s\n",
+			"Skew", "DRC", "Underruns", "Overruns", "Min", "Mean", "Max", "Ratio ppm");
+	for (double skew : skews) {
+		for (int drc = 0; drc <= 1; drc++) {
+			struct run_result r{};
+			if (!simulate(skew, drc, &null_sink, &r)) {
+				fprintf(stderr, "Failed to allocate audio stream\n");
+				return EXIT_FAILURE;
+			}
+			printf("%+7.2f%% %4s %10llu %10llu %8zu %8.0f %8zu %10u\n",
+					100 * skew, drc ? "on" : "off",
+					static_cast<unsigned long long>(r.underruns),
+					static_cast<unsigned long long>(r.overruns),
+					r.min_fill, r.mean_fill, r.max_fill, r.ratio_ppm);
+		}
+	}
+	audio_sink_close(&null_sink);
+
+	printf("\nResampler: %.1f ns / stereo frame\n", resampler_ns_per_frame());
+
+	if (wav_file != nullptr) {
+		struct audio_sink wav;
+		struct run_result r{};
+		if (!audio_sink_wav(&wav, wav_file, SAMPLE_RATE)) {
+			fprintf(stderr, "Failed to open %s\n", wav_file);
+			return EXIT_FAILURE;
+		}
+		simulate(skews[sizeof(skews) / sizeof(skews[0]) - 1], true, &wav, &r);
+		audio_sink_close(&wav);
+		printf("Wrote %s\n", wav_file);
+	}
+	return EXIT_SUCCESS;
+}
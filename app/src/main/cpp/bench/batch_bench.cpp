@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ * Parallel batch runner. Each case is a ROM run headless for a fixed number
+ * of frames in its own emulator instance, finishing with a hash of the last
+ * frame. The batch is run once on a single worker and once across a pool,
+ * to show how throughput scales, and the two runs' hashes are compared to
+ * catch any state leaking between instances.
+ */
+
+#include "bench.h"
+#include "../emulator.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+
+extern "C" {
+#include <core.h>
+}
+
+#define DEFAULT_CASES 64
+
+struct batch {
+	const char * const *roms;
+	size_t num_roms;
+	size_t num_cases;
+	unsigned int frames;
+	std::atomic<size_t> next;
+	std::atomic<size_t> failed;
+	uint64_t *hashes;
+};
+
+static double now() {
+	struct timespec ts{};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* FNV-1a */
+static uint64_t hash_frame(const uint32_t *frame) {
+	uint64_t hash = UINT64_C(14695981039346656037);
+	const auto *bytes = reinterpret_cast<const uint8_t *>(frame);
+	for (size_t i = 0; i < GBCC_SCREEN_WIDTH * GBCC_SCREEN_HEIGHT * sizeof(*frame); i++) {
+		hash ^= bytes[i];
+		hash *= UINT64_C(1099511628211);
+	}
+	return hash;
+}
+
+static bool run_case(const char *rom, unsigned int frames, uint64_t *hash) {
+	struct emulator *emu = bench_emulator_start(rom, 48000, nullptr);
+	if (emu == nullptr) {
+		return false;
+	}
+	bool success = emulator_step_frames(emu, frames);
+	if (success) {
+		bool fresh;
+		*hash = hash_frame(emulator_acquire_frame(emu, &fresh)->pixels);
+	} else {
+		fprintf(stderr, "%s: stalled\n", rom);
+	}
+	emulator_destroy(emu);
+	return success;
+}
+
+static void *worker(void *arg) {
+	auto *b = static_cast<struct batch *>(arg);
+	for (size_t i = b->next.fetch_add(1); i < b->num_cases; i = b->next.fetch_add(1)) {
+		if (!run_case(b->roms[i % b->num_roms], b->frames, &b->hashes[i])) {
+			b->failed.fetch_add(1);
+		}
+	}
+	return nullptr;
+}
+
+/* Returns the wall time taken, or a negative value on failure */
+static double run_batch(struct batch *b, unsigned int workers) {
+	b->next.store(0);
+	b->failed.store(0);
+	std::vector<pthread_t> threads;
+	threads.reserve(workers);
+	double start = now();
+	for (unsigned int i = 0; i < workers; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, nullptr, worker, b) != 0) {
+			break;
+		}
+		threads.push_back(thread);
+	}
+	for (auto &thread : threads) {
+		pthread_join(thread, nullptr);
+	}
+	double wall = now() - start;
+	return (threads.size() < workers || b->failed.load() > 0) ? -1 : wall;
+}
+
+int batch_benchmark(unsigned int workers, unsigned int frames, const char * const *roms, size_t num_roms) {
+	const char *default_rom = BENCH_DEFAULT_ROM;
+	if (num_roms == 0) {
+		roms = &default_rom;
+		num_roms = 1;
+	}
+	if (workers == 0) {
+		workers = static_cast<unsigned int>(sysconf(_SC_NPROCESSORS_ONLN));
+	}
+
+	/* Pad short lists out by repetition, so there's enough to share out */
+	struct batch b;
+	b.roms = roms;
+	b.num_roms = num_roms;
+	b.num_cases = num_roms < DEFAULT_CASES ? DEFAULT_CASES : num_roms;
+	b.frames = frames;
+	std::vector<uint64_t> serial(b.num_cases);
+	std::vector<uint64_t> parallel(b.num_cases);
+
+	b.hashes = serial.data();
+	double serial_wall = run_batch(&b, 1);
+	b.hashes = parallel.data();
+	double parallel_wall = run_batch(&b, workers);
+	if (serial_wall < 0 || parallel_wall < 0) {
+		fprintf(stderr, "Batch failed\n");
+		return EXIT_FAILURE;
+	}
+
+	size_t mismatches = 0;
+	for (size_t i = 0; i < b.num_cases; i++) {
+		if (serial[i] != parallel[i]) {
+			fprintf(stderr, "Case %zu (%s) differs between runs\n", i, roms[i % num_roms]);
+			mismatches++;
+		}
+	}
+
+	double serial_rate = b.num_cases / serial_wall;
+	double parallel_rate = b.num_cases / parallel_wall;
+	printf("Cases:         %zu (%zu ROMs, %u frames each)\n", b.num_cases, num_roms, frames);
+	printf("%-8s %10s %10s %12s\n", "Workers", "Wall (s)", "Cases / s", "Frames / s");
+	printf("%-8u %10.3f %10.1f %12.0f\n", 1, serial_wall, serial_rate, serial_rate * frames);
+	printf("%-8u %10.3f %10.1f %12.0f\n", workers, parallel_wall, parallel_rate, parallel_rate * frames);
+	printf("Speedup:       %.2fx (%.0f%% efficiency)\n",
+			parallel_rate / serial_rate,
+			100 * parallel_rate / serial_rate / workers);
+	printf("Mismatches:    %zu\n", mismatches);
+	return mismatches > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
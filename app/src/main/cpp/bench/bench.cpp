@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ * Headless benchmark.
+ *
+ * Runs a ROM through the same emulator harness as the app (emulator.h) with
+ * no speed cap, stepping it one frame per vsync post as the renderer would,
+ * and samples the emulation thread's program counter to estimate where the
+ * time goes.
+ *
+ * Usage: gbcc-bench [-n frames] [-i inputs] [rom]
+ *        gbcc-bench -c
+ *        gbcc-bench -s [rom]
+ *        gbcc-bench -a [out.wav]
+ *        gbcc-bench -p [dir]
+ *        gbcc-bench -r [-n frames] [rom]
+ *        gbcc-bench -j jobs [-n frames] [rom...]
+ *
+ * -i replays a scripted input file (see input_script.h) while running.
+ * -c runs the camera downscale microbenchmark instead.
+ * -s compares the ROM launch paths' startup time & peak memory.
+ * -a simulates the audio stream against a drifting clock, optionally
+ *    writing the resampled output of one run to a WAV file.
+ * -p compares encoding screenshots in place with queueing them for the
+ *    writer thread, saving them to dir or a new temporary directory.
+ * -r records every frame to a temporary directory, reporting what it
+ *    costs the emulator and whether the encoder kept up.
+ * -j runs a batch of ROMs, one emulator per case, on 1 worker and then on
+ *    the given number (0 for one per CPU), comparing throughput.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dlfcn.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "input_script.h"
+#include "../emulator.h"
+
+extern "C" {
+#include <core.h>
+}
+
+#define DEFAULT_FRAMES 6000
+#define DEFAULT_BATCH_FRAMES 600
+#define SAMPLE_PERIOD_NS 250000
+#define MAX_SAMPLES (1u << 20u)
+#define GB_FPS 59.7275
+
+enum subsystem {
+	SUBSYSTEM_CPU,
+	SUBSYSTEM_PPU,
+	SUBSYSTEM_APU,
+	SUBSYSTEM_MBC,
+	SUBSYSTEM_MEMORY,
+	SUBSYSTEM_OTHER,
+	SUBSYSTEM_COUNT
+};
+
+static const char * const subsystem_names[SUBSYSTEM_COUNT] = {
+	"CPU",
+	"PPU",
+	"APU",
+	"MBC",
+	"Memory",
+	"Other"
+};
+
+/*
+ * Samples are attributed by the name of the nearest exported symbol, so
+ * static functions land with whichever public function precedes them in the
+ * same file. With LTO, anything inlined is counted against its caller.
+ */
+static const struct {
+	const char *match;
+	enum subsystem subsystem;
+} symbol_map[] = {
+	{"ppu", SUBSYSTEM_PPU},
+	{"apu", SUBSYSTEM_APU},
+	{"mbc", SUBSYSTEM_MBC},
+	{"cpu", SUBSYSTEM_CPU},
+	{"ops", SUBSYSTEM_CPU},
+	{"memory", SUBSYSTEM_MEMORY},
+};
+
+static pid_t emu_tid;
+static struct input_script script;
+
+static uintptr_t samples[MAX_SAMPLES];
+static std::atomic<uint32_t> num_samples;
+
+/*
+ * Emulation thread, at each frame boundary. As with the app's input, the
+ * script is applied here so events land exactly at the start of their frame.
+ */
+static void between_frames(struct emulator *emu) {
+	if (emu_tid == 0) {
+		emu_tid = static_cast<pid_t>(syscall(SYS_gettid));
+	}
+	// Numbered from 0, the boundary just reached starts that frame
+	input_script_apply(&script, &emu->gbc, static_cast<uint32_t>(emu->boundaries - 1));
+}
+
+struct emulator *bench_emulator_start(const char *rom, unsigned int sample_rate, void (*on_frame)(struct emulator *emu)) {
+	struct emulator *emu = emulator_create();
+	if (!emulator_load(emu, rom, sample_rate, BENCH_BUFFER_FRAMES)) {
+		fprintf(stderr, "Failed to load %s: %s\n", rom, emulator_error(emu));
+		emulator_destroy(emu);
+		return nullptr;
+	}
+	strncpy(emu->gbc.save_directory, P_tmpdir, sizeof(emu->gbc.save_directory) - 1);
+
+	/* Run as fast as possible, one frame per vsync post */
+	emu->gbc.autosave = false;
+	emu->gbc.turbo_speed = 0;
+	emu->gbc.core.keys.turbo = true;
+	emu->gbc.core.sync_to_video = true;
+	emu->on_frame = on_frame;
+
+	// Stepping to the first frame boundary shows up a missing frame hook
+	if (!emulator_run(emu) || !emulator_step_frames(emu, 0)) {
+		fprintf(stderr, "%s: no frame boundaries, is the frame hook linked in?\n", rom);
+		emulator_destroy(emu);
+		return nullptr;
+	}
+	return emu;
+}
+
+static void sample_pc(int sig, siginfo_t *info, void *context) {
+	(void) sig;
+	(void) info;
+	auto *uc = static_cast<ucontext_t *>(context);
+	uintptr_t pc;
+#if defined(__x86_64__)
+	pc = static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__i386__)
+	pc = static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_EIP]);
+#elif defined(__aarch64__)
+	pc = static_cast<uintptr_t>(uc->uc_mcontext.pc);
+#elif defined(__arm__)
+	pc = static_cast<uintptr_t>(uc->uc_mcontext.arm_pc);
+#else
+	(void) uc;
+	pc = 0;
+#endif
+	uint32_t idx = num_samples.fetch_add(1, std::memory_order_relaxed);
+	if (idx < MAX_SAMPLES) {
+		samples[idx] = pc;
+	}
+}
+
+static bool start_sampling(clockid_t clock, timer_t *timer) {
+	struct sigaction sa{};
+	sa.sa_sigaction = sample_pc;
+	sa.sa_flags = SA_SIGINFO | SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGPROF, &sa, nullptr) != 0) {
+		return false;
+	}
+
+	struct sigevent sev{};
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo = SIGPROF;
+	sev._sigev_un._tid = emu_tid;
+	if (timer_create(clock, &sev, timer) != 0) {
+		return false;
+	}
+
+	struct itimerspec its{};
+	its.it_interval.tv_nsec = SAMPLE_PERIOD_NS;
+	its.it_value.tv_nsec = SAMPLE_PERIOD_NS;
+	return timer_settime(*timer, 0, &its, nullptr) == 0;
+}
+
+static enum subsystem classify(uintptr_t pc) {
+	Dl_info info;
+	if (pc == 0 || dladdr(reinterpret_cast<void *>(pc), &info) == 0 || info.dli_sname == nullptr) {
+		return SUBSYSTEM_OTHER;
+	}
+	for (const auto &entry : symbol_map) {
+		if (strstr(info.dli_sname, entry.match) != nullptr) {
+			return entry.subsystem;
+		}
+	}
+	return SUBSYSTEM_OTHER;
+}
+
+static double timespec_to_sec(struct timespec ts) {
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr, "Usage: %s [-n frames] [-i inputs] [rom]\n", name);
+	fprintf(stderr, "       %s -c\n", name);
+	fprintf(stderr, "       %s -s [rom]\n", name);
+	fprintf(stderr, "       %s -a [out.wav]\n", name);
+	fprintf(stderr, "       %s -p [dir]\n", name);
+	fprintf(stderr, "       %s -r [-n frames] [rom]\n", name);
+	fprintf(stderr, "       %s -j jobs [-n frames] [rom...]\n", name);
+}
+
+int main(int argc, char **argv) {
+	long frames = DEFAULT_FRAMES;
+	bool frames_set = false;
+	long jobs = -1;
+	const char *rom = BENCH_DEFAULT_ROM;
+	const char *inputs = nullptr;
+	bool startup = false;
+	bool audio = false;
+	bool screenshot = false;
+	bool record = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "achi:j:n:prs")) != -1) {
+		switch (opt) {
+			case 'a':
+				audio = true;
+				break;
+			case 'c':
+				return camera_benchmark();
+			case 'p':
+				screenshot = true;
+				break;
+			case 'r':
+				record = true;
+				break;
+			case 's':
+				startup = true;
+				break;
+			case 'i':
+				inputs = optarg;
+				break;
+			case 'j':
+				jobs = strtol(optarg, nullptr, 0);
+				break;
+			case 'n':
+				frames = strtol(optarg, nullptr, 0);
+				frames_set = true;
+				break;
+			case 'h':
+				usage(argv[0]);
+				return EXIT_SUCCESS;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if (audio) {
+		return audio_benchmark(optind < argc ? argv[optind] : nullptr);
+	}
+	if (screenshot) {
+		return screenshot_benchmark(optind < argc ? argv[optind] : nullptr);
+	}
+	if (jobs >= 0) {
+		if (!frames_set) {
+			frames = DEFAULT_BATCH_FRAMES;
+		}
+		if (frames <= 0) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		return batch_benchmark(
+				static_cast<unsigned int>(jobs),
+				static_cast<unsigned int>(frames),
+				&argv[optind],
+				static_cast<size_t>(argc - optind));
+	}
+	if (optind < argc) {
+		rom = argv[optind];
+	}
+	if (startup) {
+		return startup_benchmark(rom);
+	}
+	if (frames <= 0) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (record) {
+		return record_benchmark(rom, frames);
+	}
+
+	if (inputs != nullptr) {
+		char error[256];
+		if (!input_script_load(&script, inputs, error, sizeof(error))) {
+			fprintf(stderr, "%s\n", error);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// The first frame boundary tells us which thread to sample
+	struct emulator *emu = bench_emulator_start(rom, 48000, between_frames);
+	if (emu == nullptr) {
+		return EXIT_FAILURE;
+	}
+
+	clockid_t emu_clock;
+	timer_t timer;
+	bool sampling = pthread_getcpuclockid(emu->thread, &emu_clock) == 0
+		&& start_sampling(emu_clock, &timer);
+	if (!sampling) {
+		fprintf(stderr, "Warning: sampling disabled (%s)\n", strerror(errno));
+	}
+
+	struct timespec start;
+	struct timespec end;
+	struct timespec cpu_start{};
+	struct timespec cpu_end{};
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (sampling) {
+		clock_gettime(emu_clock, &cpu_start);
+	}
+
+	if (!emulator_step_frames(emu, static_cast<unsigned int>(frames))) {
+		fprintf(stderr, "Stalled after %llu of %ld frames\n",
+				static_cast<unsigned long long>(emu->frames.load() - 1), frames);
+		emulator_destroy(emu);
+		return EXIT_FAILURE;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if (sampling) {
+		clock_gettime(emu_clock, &cpu_end);
+		timer_delete(timer);
+	}
+	emulator_destroy(emu);
+
+	double wall = timespec_to_sec(end) - timespec_to_sec(start);
+	double cpu = timespec_to_sec(cpu_end) - timespec_to_sec(cpu_start);
+	double fps = frames / wall;
+
+	printf("ROM:           %s\n", rom);
+	printf("Frames:        %ld\n", frames);
+	if (inputs != nullptr) {
+		printf("Inputs:        %s (%zu events)\n", inputs, script.events.size());
+	}
+	printf("Wall time:     %.3f s\n", wall);
+	printf("Emulated FPS:  %.1f (%.1fx real time)\n", fps, fps / GB_FPS);
+	printf("Time / frame:  %.1f us\n", 1e6 * wall / frames);
+
+	if (sampling) {
+		uint32_t n = std::min(num_samples.load(), MAX_SAMPLES);
+		uint32_t counts[SUBSYSTEM_COUNT] = {0};
+		for (uint32_t i = 0; i < n; i++) {
+			counts[classify(samples[i])]++;
+		}
+		printf("Thread CPU:    %.3f s (%u samples)\n\n", cpu, n);
+		printf("%-10s %8s %8s %12s\n", "Subsystem", "Samples", "Share", "us / frame");
+		for (int i = 0; i < SUBSYSTEM_COUNT; i++) {
+			double share = n > 0 ? static_cast<double>(counts[i]) / n : 0;
+			printf("%-10s %8u %7.1f%% %12.2f\n",
+					subsystem_names[i],
+					counts[i],
+					100 * share,
+					1e6 * share * cpu / frames);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
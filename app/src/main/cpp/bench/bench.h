@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_BENCH_H
+#define GBCC_ANDROID_BENCH_H
+
+#include <cstddef>
+
+/* Stereo frames per buffer the core mixes */
+#define BENCH_BUFFER_FRAMES 1024
+
+struct emulator;
+
+/*
+ * Load a ROM into a new emulator set up to run flat out, one frame per
+ * step, and run it to its first frame boundary. on_frame may be null.
+ * Returns null, having printed why, on failure.
+ */
+struct emulator *bench_emulator_start(const char *rom, unsigned int sample_rate, void (*on_frame)(struct emulator *emu));
+
+/* Standalone microbenchmarks, each returning an exit status */
+int camera_benchmark();
+int startup_benchmark(const char *rom);
+int audio_benchmark(const char *wav_file);
+int screenshot_benchmark(const char *directory);
+int record_benchmark(const char *rom, long frames);
+int batch_benchmark(unsigned int workers, unsigned int frames, const char * const *roms, size_t num_roms);
+
+#endif /* GBCC_ANDROID_BENCH_H */
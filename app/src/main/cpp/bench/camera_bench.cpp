@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ * Camera downscale microbenchmark, comparing camera_downscale against the
+ * original full-frame box blur, which is kept here as the reference output.
+ */
+
+#include "bench.h"
+#include "../camera_downscale.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#define OUT_SIZE (CAMERA_DOWNSCALE_SIZE * CAMERA_DOWNSCALE_SIZE)
+#define MIN_BENCH_SECONDS 0.2
+
+static const struct {
+	int width;
+	int height;
+	int row_stride;
+} geometries[] = {
+	{320, 240, 320},
+	{240, 320, 256},
+	{640, 480, 704},
+	{1280, 720, 1280},
+	{1920, 1080, 1920},
+};
+
+static const int rotations[] = {0, 90, 180, 270};
+
+static void camera_reference(uint8_t *image, int width, int height, int rotation, int rowStride, uint8_t *out) {
+	int box_size = std::min(width, height) / 128 / 2 + 1;
+
+	auto *new_row = static_cast<uint8_t *>(calloc(width, 1));
+	for (int j = 0; j < height; j++) {
+		uint8_t *row = &image[j * rowStride];
+		int sum = 0;
+		int div = 0;
+
+		for (int i = -box_size; i < width; i++) {
+			if (i < width - box_size) {
+				sum += row[i + box_size];
+			} else {
+				div--;
+			}
+			if (i >= box_size) {
+				sum -= row[i - box_size];
+			} else {
+				div++;
+			}
+
+			if (i >= 0) {
+				new_row[i] = static_cast<uint8_t>(sum / div);
+			}
+		}
+		memcpy(row, new_row, width);
+	}
+	free(new_row);
+
+	auto *new_col = static_cast<uint8_t *>(calloc(height, 1));
+	for (int i = 0; i < width; i++) {
+		int sum = 0;
+		int div = 0;
+
+		for (int j = -box_size; j < height; j++) {
+			if (j < height - box_size) {
+				sum += image[(j + box_size) * rowStride + i];
+			} else {
+				div--;
+			}
+			if (j >= box_size) {
+				sum -= image[(j - box_size) * rowStride + i];
+			} else {
+				div++;
+			}
+
+			if (j >= 0) {
+				new_col[j] = static_cast<uint8_t>(sum / div);
+			}
+		}
+		for (int j = 0; j < height; j++) {
+			image[j * rowStride + i] = new_col[j];
+		}
+	}
+	free(new_col);
+
+	double scale = std::min(height, width) / 128.0;
+	for (int j = 0; j < 128; j++) {
+		for (int i = 0; i < 128; i++) {
+			int src_idx = (int)(j * scale) * rowStride + (int)(i * scale);
+			int dst_idx;
+			if (rotation == 90) {
+				dst_idx = i * 128 + (127 - j);
+			} else if (rotation == 180) {
+				dst_idx = (127 - j) * 128 + (127 - i);
+			} else if (rotation == 270) {
+				dst_idx = (127 - i) * 128 + j;
+			} else {
+				dst_idx = j * 128 + i;
+			}
+
+			out[dst_idx] = image[src_idx];
+		}
+	}
+}
+
+/* Noise on top of a gradient, so both the blur and the rotation matter */
+static void fill_image(uint8_t *image, int width, int height, int row_stride, uint32_t seed) {
+	uint32_t x = seed;
+	for (int j = 0; j < height; j++) {
+		for (int i = 0; i < row_stride; i++) {
+			x ^= x << 13u;
+			x ^= x >> 17u;
+			x ^= x << 5u;
+			int val = (i * 255 / width + j * 255 / height) / 2 + static_cast<int>(x % 64) - 32;
+			image[j * row_stride + i] = static_cast<uint8_t>(std::clamp(val, 0, 255));
+		}
+	}
+}
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int camera_benchmark() {
+	struct camera_downscale ds = {};
+	uint8_t ref_out[OUT_SIZE];
+	uint8_t out[OUT_SIZE];
+	int failures = 0;
+
+	printf("%-16s %4s %12s %12s %8s %10s\n", "Geometry", "Rot", "Reference us", "Kernel us", "Speedup", "Mismatches");
+	for (const auto &g : geometries) {
+		size_t size = static_cast<size_t>(g.row_stride) * g.height;
+		auto *image = static_cast<uint8_t *>(malloc(size));
+		auto *scratch = static_cast<uint8_t *>(malloc(size));
+		fill_image(image, g.width, g.height, g.row_stride, static_cast<uint32_t>(size));
+
+		for (int rotation : rotations) {
+			memcpy(scratch, image, size);
+			camera_reference(scratch, g.width, g.height, rotation, g.row_stride, ref_out);
+
+			if (camera_downscale_needs_configure(&ds, g.width, g.height, g.row_stride, rotation)
+					&& !camera_downscale_configure(&ds, g.width, g.height, g.row_stride, rotation)) {
+				fprintf(stderr, "Out of memory\n");
+				free(scratch);
+				free(image);
+				camera_downscale_destroy(&ds);
+				return EXIT_FAILURE;
+			}
+			camera_downscale_run(&ds, image, out);
+
+			int mismatches = 0;
+			for (int i = 0; i < OUT_SIZE; i++) {
+				mismatches += (out[i] != ref_out[i]);
+			}
+			if (mismatches > 0) {
+				failures++;
+			}
+
+			/* The reference blurs in place, but the cost doesn't depend on the contents */
+			int ref_iters = 0;
+			double start = now();
+			double ref_time;
+			do {
+				camera_reference(scratch, g.width, g.height, rotation, g.row_stride, ref_out);
+				ref_iters++;
+				ref_time = now() - start;
+			} while (ref_time < MIN_BENCH_SECONDS);
+
+			int iters = 0;
+			start = now();
+			double time;
+			do {
+				camera_downscale_run(&ds, image, out);
+				iters++;
+				time = now() - start;
+			} while (time < MIN_BENCH_SECONDS);
+
+			double ref_us = 1e6 * ref_time / ref_iters;
+			double us = 1e6 * time / iters;
+			char geometry[32];
+			snprintf(geometry, sizeof(geometry), "%dx%d/%d", g.width, g.height, g.row_stride);
+			printf("%-16s %4d %12.1f %12.1f %7.1fx %10d\n", geometry, rotation, ref_us, us, ref_us / us, mismatches);
+		}
+		free(scratch);
+		free(image);
+	}
+	camera_downscale_destroy(&ds);
+
+	if (failures > 0) {
+		fprintf(stderr, "camera_downscale output differs from the reference in %d cases\n", failures);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
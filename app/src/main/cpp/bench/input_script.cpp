@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#include "input_script.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#define MAX_LINE 256
+
+static const struct {
+	const char *name;
+	enum gbcc_key key;
+} key_names[] = {
+	{"a", GBCC_KEY_A},
+	{"b", GBCC_KEY_B},
+	{"start", GBCC_KEY_START},
+	{"select", GBCC_KEY_SELECT},
+	{"up", GBCC_KEY_UP},
+	{"down", GBCC_KEY_DOWN},
+	{"left", GBCC_KEY_LEFT},
+	{"right", GBCC_KEY_RIGHT},
+};
+
+static bool parse_key(const char *name, enum gbcc_key *key) {
+	for (const auto &entry : key_names) {
+		if (strcmp(name, entry.name) == 0) {
+			*key = entry.key;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool input_script_load(struct input_script *script, const char *filename, char *error, size_t error_len) {
+	FILE *fp = fopen(filename, "r");
+	if (fp == nullptr) {
+		snprintf(error, error_len, "Failed to open %s: %s", filename, strerror(errno));
+		return false;
+	}
+
+	script->events.clear();
+	script->next = 0;
+	char line[MAX_LINE];
+	unsigned int line_number = 0;
+	while (fgets(line, sizeof(line), fp) != nullptr) {
+		line_number++;
+		char *comment = strchr(line, '#');
+		if (comment != nullptr) {
+			*comment = '\0';
+		}
+
+		char key[16];
+		char action[16];
+		struct input_event event{};
+		int n = sscanf(line, "%" SCNu32 " %15s %15s", &event.frame, key, action);
+		if (n == EOF) {
+			continue;
+		}
+		bool valid = n == 3 && parse_key(key, &event.key);
+		if (valid && strcmp(action, "press") == 0) {
+			event.pressed = true;
+		} else if (valid && strcmp(action, "release") == 0) {
+			event.pressed = false;
+		} else {
+			valid = false;
+		}
+		if (!valid) {
+			snprintf(error, error_len, "%s:%u: expected \"<frame> <key> <press|release>\"",
+					filename, line_number);
+			fclose(fp);
+			return false;
+		}
+		if (!script->events.empty() && event.frame < script->events.back().frame) {
+			snprintf(error, error_len, "%s:%u: events out of order", filename, line_number);
+			fclose(fp);
+			return false;
+		}
+		script->events.push_back(event);
+	}
+	fclose(fp);
+	return true;
+}
+
+void input_script_apply(struct input_script *script, struct gbcc *gbc, uint32_t frame) {
+	while (script->next < script->events.size() && script->events[script->next].frame <= frame) {
+		const struct input_event &event = script->events[script->next++];
+		gbcc_input_process_key(gbc, event.key, event.pressed);
+	}
+}
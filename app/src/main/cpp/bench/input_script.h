@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_INPUT_SCRIPT_H
+#define GBCC_ANDROID_INPUT_SCRIPT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+extern "C" {
+#include <gbcc.h>
+}
+
+/*
+ * Scripted joypad input for headless runs.
+ *
+ * A script is a text file of "<frame> <key> <press|release>" lines, with
+ * keys named a, b, start, select, up, down, left or right, in frame order.
+ * Blank lines and anything after a '#' are ignored.
+ */
+
+struct input_event {
+	uint32_t frame;
+	enum gbcc_key key;
+	bool pressed;
+};
+
+struct input_script {
+	std::vector<struct input_event> events;
+	size_t next;
+};
+
+bool input_script_load(struct input_script *script, const char *filename, char *error, size_t error_len);
+
+/* Apply every event due at or before the given frame */
+void input_script_apply(struct input_script *script, struct gbcc *gbc, uint32_t frame);
+
+#endif /* GBCC_ANDROID_INPUT_SCRIPT_H */
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ * Null stand-ins for the platform hooks that gbcc.cpp and audio_output.cpp provide
+ * on Android, so the core can be run headless on a desktop machine.
+ */
+
+#include "bench.h"
+#include "../recorder.h"
+
+#include <cstring>
+
+extern "C" {
+#include <gbcc.h>
+#include <audio.h>
+#include <camera.h>
+#include <printer_platform.h>
+#include <window.h>
+}
+
+void gbcc_camera_platform_initialise(struct gbcc_camera_platform *camera) {
+	(void) camera;
+}
+
+void gbcc_camera_platform_destroy(struct gbcc_camera_platform *camera) {
+	(void) camera;
+}
+
+void gbcc_camera_platform_capture_image(struct gbcc_camera_platform *camera, uint8_t image[GB_CAMERA_SENSOR_SIZE]) {
+	(void) camera;
+	memset(image, 0x80, GB_CAMERA_SENSOR_SIZE);
+}
+
+void gbcc_printer_platform_start_printing(struct printer *printer) {
+	(void) printer;
+}
+
+extern "C" void gbcc_screenshot(struct gbcc *gb) {
+	(void) gb;
+}
+
+extern "C" void gbcc_fontmap_load(struct gbcc_fontmap *font) {
+	font->bitmap = nullptr;
+	font->tile_width = 0;
+	font->tile_height = 0;
+}
+
+extern "C" void gbcc_fontmap_destroy(struct gbcc_fontmap *font) {
+	(void) font;
+}
+
+/* Audio is generated by the APU as normal, then only kept if recording */
+extern "C" void gbcc_audio_platform_initialise(struct gbcc_audio *audio) {
+	(void) audio;
+}
+
+extern "C" void gbcc_audio_platform_destroy(struct gbcc_audio *audio) {
+	(void) audio;
+}
+
+extern "C" void gbcc_audio_platform_queue_buffer(struct gbcc_audio *audio) {
+	recorder_push_audio(audio->mix_buffer, BENCH_BUFFER_FRAMES);
+}
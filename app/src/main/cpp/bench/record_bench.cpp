@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ * Recorder benchmark. Runs a ROM one frame at a time, first on its own and
+ * then recording every frame, and reports what recording costs the
+ * producer, and whether the encoder kept up.
+ *
+ * As in the app, the core's mixed samples reach the recorder from the
+ * emulation thread, so the audio path is exercised too, and the two streams
+ * are checked to come out the same length.
+ */
+
+#include "bench.h"
+#include "../emulator.h"
+#include "../recorder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+extern "C" {
+#include <core.h>
+}
+
+#define SAMPLE_RATE 48000
+#define GB_FPS 59.7275
+
+static double now() {
+	struct timespec ts{};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int record_benchmark(const char *rom, long frames) {
+	char tmpdir[] = P_tmpdir "/gbcc-recording-XXXXXX";
+	const char *directory = mkdtemp(tmpdir);
+	if (directory == nullptr) {
+		perror("mkdtemp");
+		return EXIT_FAILURE;
+	}
+
+	struct emulator *emu = bench_emulator_start(rom, SAMPLE_RATE, nullptr);
+	if (emu == nullptr) {
+		return EXIT_FAILURE;
+	}
+	double t = now();
+	if (!emulator_step_frames(emu, static_cast<unsigned int>(frames))) {
+		fprintf(stderr, "%s: stalled\n", rom);
+		emulator_destroy(emu);
+		return EXIT_FAILURE;
+	}
+	double baseline = now() - t;
+	emulator_destroy(emu);
+
+	emu = bench_emulator_start(rom, SAMPLE_RATE, nullptr);
+	if (emu == nullptr) {
+		return EXIT_FAILURE;
+	}
+	if (!recorder_begin(directory, "bench", SAMPLE_RATE)) {
+		fprintf(stderr, "Failed to start recording in %s\n", directory);
+		emulator_destroy(emu);
+		return EXIT_FAILURE;
+	}
+
+	std::vector<double> push_us(static_cast<size_t>(frames));
+	t = now();
+	for (long i = 0; i < frames; i++) {
+		if (!emulator_step_frames(emu, 1)) {
+			fprintf(stderr, "%s: stalled\n", rom);
+			recorder_end();
+			emulator_destroy(emu);
+			return EXIT_FAILURE;
+		}
+
+		double p = now();
+		bool fresh;
+		recorder_push_frame(emulator_acquire_frame(emu, &fresh)->pixels);
+		push_us[static_cast<size_t>(i)] = 1e6 * (now() - p);
+	}
+	double recording = now() - t;
+	double end = now();
+	recorder_end();
+	double drain = now() - end;
+	emulator_destroy(emu);
+
+	struct recorder_stats stats = recorder_get_stats();
+	double mean = 0;
+	for (double us : push_us) {
+		mean += us;
+	}
+	mean /= frames;
+	std::sort(push_us.begin(), push_us.end());
+
+	printf("ROM:           %s\n", rom);
+	printf("Output:        %s\n", directory);
+	printf("Frames:        %ld\n", frames);
+	printf("Baseline:      %.1f fps\n", frames / baseline);
+	printf("Recording:     %.1f fps (%.1f ms to drain at the end)\n", frames / recording, 1e3 * drain);
+	printf("Frame push:    %.2f us mean, %.2f us p99, %.2f us max\n",
+			mean, push_us[push_us.size() * 99 / 100], push_us.back());
+	printf("Video:         %llu frames written, %llu dropped & repeated\n",
+			static_cast<unsigned long long>(stats.frames_written),
+			static_cast<unsigned long long>(stats.frames_dropped));
+	printf("Audio:         %llu frames written, %llu dropped & silenced\n",
+			static_cast<unsigned long long>(stats.audio_written),
+			static_cast<unsigned long long>(stats.audio_dropped));
+	printf("Durations:     %.3f s video, %.3f s audio\n",
+			stats.frames_written / GB_FPS,
+			static_cast<double>(stats.audio_written) / SAMPLE_RATE);
+
+	// Audio arrives a whole buffer at a time, so may be up to one out
+	double skew = stats.frames_written / GB_FPS - static_cast<double>(stats.audio_written) / SAMPLE_RATE;
+	bool ok = stats.frames_written == static_cast<uint64_t>(frames)
+		&& std::abs(skew) <= static_cast<double>(BENCH_BUFFER_FRAMES) / SAMPLE_RATE;
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
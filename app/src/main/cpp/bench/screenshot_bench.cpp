@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ * Screenshot stall benchmark. Compares the time the calling thread loses to
+ * encoding & writing a PNG in place with the cost of screenshot_capture,
+ * which only copies the frame, for captures paced like a burst of button
+ * presses.
+ */
+
+#include "bench.h"
+#include "../screenshot_writer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+extern "C" {
+#include <core.h>
+}
+
+#define INLINE_RUNS 20
+#define CAPTURES 120
+#define CAPTURE_INTERVAL_NS 4000000
+
+static const unsigned int scales[] = {1, 4};
+
+static double now() {
+	struct timespec ts{};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Background tiles & a few flat areas, in four DMG shades */
+static void make_frame(uint32_t *frame) {
+	static const uint32_t shades[4] = {0xC4CFA1FFu, 0x8B956DFFu, 0x4D533CFFu, 0x1F1F1FFFu};
+	uint32_t seed = 12345;
+	uint8_t tiles[16][64];
+	for (auto &tile : tiles) {
+		for (auto &px : tile) {
+			seed = seed * 1103515245u + 12345u;
+			px = static_cast<uint8_t>((seed >> 16u) & 3u);
+		}
+	}
+	for (int y = 0; y < GBCC_SCREEN_HEIGHT; y++) {
+		for (int x = 0; x < GBCC_SCREEN_WIDTH; x++) {
+			int tile = ((y / 8) * 7 + (x / 8) * 3) % 16;
+			uint8_t shade = (y / 8) % 5 == 0 ? 0 : tiles[tile][(y % 8) * 8 + x % 8];
+			frame[y * GBCC_SCREEN_WIDTH + x] = shades[shade];
+		}
+	}
+}
+
+static bool write_png(const std::string &path, const std::vector<uint8_t> &png) {
+	int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	bool ok = write(fd, png.data(), png.size()) == static_cast<ssize_t>(png.size());
+	return close(fd) == 0 && ok;
+}
+
+int screenshot_benchmark(const char *directory) {
+	char tmpdir[] = P_tmpdir "/gbcc-screenshots-XXXXXX";
+	if (directory == nullptr) {
+		directory = mkdtemp(tmpdir);
+		if (directory == nullptr) {
+			perror("mkdtemp");
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<uint32_t> frame(GBCC_SCREEN_WIDTH * GBCC_SCREEN_HEIGHT);
+	make_frame(frame.data());
+
+	printf("Output:        %s\n", directory);
+	printf("%-6s %10s %12s %10s %10s %10s %8s %8s\n",
+			"Scale", "PNG bytes", "Inline (us)",
+			"Capture", "p99 (us)", "Max (us)", "Written", "Dropped");
+
+	std::vector<uint8_t> png;
+	std::vector<double> stalls(CAPTURES);
+	for (unsigned int scale : scales) {
+		double start = now();
+		for (int i = 0; i < INLINE_RUNS; i++) {
+			std::string path = std::string(directory) + "/inline-x" + std::to_string(scale) + ".png";
+			if (!screenshot_encode_png(frame.data(), scale, &png) || !write_png(path, png)) {
+				fprintf(stderr, "Failed to write %s\n", path.c_str());
+				return EXIT_FAILURE;
+			}
+		}
+		double inline_us = 1e6 * (now() - start) / INLINE_RUNS;
+
+		std::string prefix = "capture-x" + std::to_string(scale);
+		if (!screenshot_begin(directory, prefix.c_str())) {
+			fprintf(stderr, "Failed to start the screenshot writer\n");
+			return EXIT_FAILURE;
+		}
+		struct screenshot_stats before = screenshot_get_stats();
+		screenshot_set_scale(scale);
+		const struct timespec interval = {0, CAPTURE_INTERVAL_NS};
+		for (double &stall : stalls) {
+			double t = now();
+			screenshot_capture(frame.data());
+			stall = 1e6 * (now() - t);
+			nanosleep(&interval, nullptr);
+		}
+		screenshot_end();
+		struct screenshot_stats after = screenshot_get_stats();
+
+		double mean = 0;
+		for (double stall : stalls) {
+			mean += stall;
+		}
+		mean /= CAPTURES;
+		std::sort(stalls.begin(), stalls.end());
+		printf("%-6u %10zu %12.1f %10.2f %10.2f %10.2f %8llu %8llu\n",
+				scale,
+				png.size(),
+				inline_us,
+				mean,
+				stalls[CAPTURES * 99 / 100],
+				stalls[CAPTURES - 1],
+				static_cast<unsigned long long>(after.written - before.written),
+				static_cast<unsigned long long>(after.dropped - before.dropped));
+		if (after.failed != before.failed) {
+			fprintf(stderr, "%llu screenshots failed to write\n",
+					static_cast<unsigned long long>(after.failed - before.failed));
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+/*
+ * ROM launch microbenchmark, comparing the old checkRom + loadRom sequence
+ * (initialise, free, initialise) against the header-only check followed by
+ * a single initialise, which now goes through emulator_load() as loadRom
+ * does. Each launch runs in a fresh child process, so the
+ * peak RSS reported is that of the launch alone.
+ */
+
+#include "bench.h"
+#include "../emulator.h"
+#include "../rom_header.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern "C" {
+#include <core.h>
+}
+
+#define LAUNCHES 20
+
+enum launch_path {
+	LAUNCH_DOUBLE_LOAD,
+	LAUNCH_HEADER_CHECK
+};
+
+/* checkRom's throwaway load, too big for the stack */
+static struct gbcc_core core;
+
+static double now() {
+	struct timespec ts{};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool launch(const char *rom, enum launch_path path) {
+	if (path == LAUNCH_DOUBLE_LOAD) {
+		gbcc_initialise(&core, rom);
+		if (!core.initialised) {
+			return false;
+		}
+		gbcc_free(&core);
+	} else {
+		struct rom_header header{};
+		char error[ROM_HEADER_ERROR_LEN];
+		if (!rom_header_read(rom, &header, error, sizeof(error))) {
+			fprintf(stderr, "%s\n", error);
+			return false;
+		}
+	}
+	struct emulator *emu = emulator_create();
+	bool loaded = emulator_load(emu, rom, 48000, 1024);
+	emulator_destroy(emu);
+	return loaded;
+}
+
+/* Launch in a child, returning its wall time & peak RSS in KiB */
+static bool measure(const char *rom, enum launch_path path, double *seconds, long *max_rss) {
+	double start = now();
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return false;
+	}
+	if (pid == 0) {
+		_exit(launch(rom, path) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	int status;
+	struct rusage usage{};
+	if (wait4(pid, &status, 0, &usage) < 0) {
+		perror("wait4");
+		return false;
+	}
+	*seconds = now() - start;
+	*max_rss = usage.ru_maxrss;
+	return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+int startup_benchmark(const char *rom) {
+	static const char * const names[] = {
+		"init + free + init",
+		"header + init"
+	};
+
+	printf("%-20s %12s %12s\n", "Launch path", "Time (ms)", "Max RSS (KiB)");
+	for (int p = LAUNCH_DOUBLE_LOAD; p <= LAUNCH_HEADER_CHECK; p++) {
+		double total = 0;
+		long rss = 0;
+		for (int i = 0; i < LAUNCHES; i++) {
+			double seconds;
+			long max_rss;
+			if (!measure(rom, static_cast<enum launch_path>(p), &seconds, &max_rss)) {
+				fprintf(stderr, "Failed to launch %s\n", rom);
+				return EXIT_FAILURE;
+			}
+			total += seconds;
+			rss = std::max(rss, max_rss);
+		}
+		printf("%-20s %12.3f %12ld\n", names[p], total / LAUNCHES * 1000, rss);
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#include "camera_downscale.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define SIMD_WIDTH 16
+
+/* 16 set bytes followed by 16 clear bytes, to mask off the end of a window */
+static const uint8_t window_mask[2 * SIMD_WIDTH] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0
+};
+
+/*
+ * Exact floor(sum / count) for the small sums we deal with here,
+ * using recip = 2^32 / count + 1.
+ */
+static inline uint8_t divide(uint32_t sum, uint64_t recip) {
+	return static_cast<uint8_t>((sum * recip) >> 32u);
+}
+
+static inline uint64_t reciprocal(int count) {
+	return (UINT64_C(1) << 32u) / static_cast<uint64_t>(count) + 1;
+}
+
+/* Sum of count <= 16 bytes, reading (but ignoring) up to 16 */
+static inline uint32_t window_sum_simd(const uint8_t *src, int count) {
+	const uint8_t *mask = &window_mask[SIMD_WIDTH - count];
+#if defined(__ARM_NEON) && defined(__aarch64__)
+	return vaddlvq_u8(vandq_u8(vld1q_u8(src), vld1q_u8(mask)));
+#elif defined(__ARM_NEON)
+	uint64x2_t sum = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(vandq_u8(vld1q_u8(src), vld1q_u8(mask)))));
+	return static_cast<uint32_t>(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+#elif defined(__SSE2__)
+	__m128i v = _mm_and_si128(
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)),
+			_mm_loadu_si128(reinterpret_cast<const __m128i *>(mask)));
+	__m128i sum = _mm_sad_epu8(v, _mm_setzero_si128());
+	return static_cast<uint32_t>(_mm_cvtsi128_si32(sum) + _mm_extract_epi16(sum, 4));
+#else
+	(void) mask;
+	uint32_t sum = 0;
+	for (int i = 0; i < count; i++) {
+		sum += src[i];
+	}
+	return sum;
+#endif
+}
+
+static inline uint32_t window_sum(const uint8_t *src, int count) {
+	uint32_t sum = 0;
+	for (int i = 0; i < count; i++) {
+		sum += src[i];
+	}
+	return sum;
+}
+
+/* acc[i] += row[i] for a full row of samples */
+static inline void accumulate_row(uint16_t *acc, const uint8_t *row) {
+#if defined(__ARM_NEON)
+	for (int i = 0; i < CAMERA_DOWNSCALE_SIZE; i += SIMD_WIDTH) {
+		uint8x16_t v = vld1q_u8(row + i);
+		vst1q_u16(acc + i, vaddw_u8(vld1q_u16(acc + i), vget_low_u8(v)));
+		vst1q_u16(acc + i + 8, vaddw_u8(vld1q_u16(acc + i + 8), vget_high_u8(v)));
+	}
+#elif defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	for (int i = 0; i < CAMERA_DOWNSCALE_SIZE; i += SIMD_WIDTH) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+		auto *lo = reinterpret_cast<__m128i *>(acc + i);
+		auto *hi = reinterpret_cast<__m128i *>(acc + i + 8);
+		_mm_storeu_si128(lo, _mm_add_epi16(_mm_loadu_si128(lo), _mm_unpacklo_epi8(v, zero)));
+		_mm_storeu_si128(hi, _mm_add_epi16(_mm_loadu_si128(hi), _mm_unpackhi_epi8(v, zero)));
+	}
+#else
+	for (int i = 0; i < CAMERA_DOWNSCALE_SIZE; i++) {
+		acc[i] += row[i];
+	}
+#endif
+}
+
+bool camera_downscale_needs_configure(const struct camera_downscale *ds, int width, int height, int row_stride, int rotation) {
+	return ds->rows == nullptr
+		|| ds->width != width
+		|| ds->height != height
+		|| ds->row_stride != row_stride
+		|| ds->rotation != rotation;
+}
+
+bool camera_downscale_configure(struct camera_downscale *ds, int width, int height, int row_stride, int rotation) {
+	ds->width = width;
+	ds->height = height;
+	ds->row_stride = row_stride;
+	ds->rotation = rotation;
+
+	/*
+	 * The blur window for a pixel p covers [p - box_size + 1, p + box_size],
+	 * clipped to the image, and the samples are taken at (int)(n * scale).
+	 * Both of these match the original full-frame implementation exactly.
+	 */
+	int box_size = std::min(width, height) / CAMERA_DOWNSCALE_SIZE / 2 + 1;
+	double scale = std::min(height, width) / static_cast<double>(CAMERA_DOWNSCALE_SIZE);
+
+	for (int n = 0; n < CAMERA_DOWNSCALE_SIZE; n++) {
+		int p = static_cast<int>(n * scale);
+
+		int start = std::max(0, p - box_size + 1);
+		int end = std::min(width - 1, p + box_size);
+		ds->h_start[n] = start;
+		ds->h_count[n] = end - start + 1;
+		ds->h_recip[n] = reciprocal(ds->h_count[n]);
+		ds->h_simd[n] = (ds->h_count[n] <= SIMD_WIDTH) && (start + SIMD_WIDTH <= width);
+
+		start = std::max(0, p - box_size + 1);
+		end = std::min(height - 1, p + box_size);
+		ds->v_start[n] = start;
+		ds->v_count[n] = end - start + 1;
+		ds->v_recip[n] = reciprocal(ds->v_count[n]);
+	}
+
+	ds->first_row = ds->v_start[0];
+	ds->num_rows = ds->v_start[CAMERA_DOWNSCALE_SIZE - 1] + ds->v_count[CAMERA_DOWNSCALE_SIZE - 1] - ds->first_row;
+
+	size_t size = static_cast<size_t>(ds->num_rows) * CAMERA_DOWNSCALE_SIZE;
+	if (size > ds->rows_capacity) {
+		auto *rows = static_cast<uint8_t *>(malloc(size));
+		if (rows == nullptr) {
+			// Keep the old buffer, and make sure the next frame tries again
+			ds->width = 0;
+			return false;
+		}
+		free(ds->rows);
+		ds->rows = rows;
+		ds->rows_capacity = size;
+	}
+	return true;
+}
+
+void camera_downscale_run(struct camera_downscale *ds, const uint8_t *image, uint8_t *out) {
+	const int size = CAMERA_DOWNSCALE_SIZE;
+
+	// Horizontal blur, only at the sampled columns of the rows we need
+	for (int r = 0; r < ds->num_rows; r++) {
+		const uint8_t *src = &image[static_cast<size_t>(ds->first_row + r) * ds->row_stride];
+		uint8_t *dst = &ds->rows[r * size];
+		for (int i = 0; i < size; i++) {
+			uint32_t sum;
+			if (ds->h_simd[i]) {
+				sum = window_sum_simd(&src[ds->h_start[i]], ds->h_count[i]);
+			} else {
+				sum = window_sum(&src[ds->h_start[i]], ds->h_count[i]);
+			}
+			dst[i] = divide(sum, ds->h_recip[i]);
+		}
+	}
+
+	// Vertical blur of those samples, rotating as we write them out
+	alignas(16) uint16_t acc[CAMERA_DOWNSCALE_SIZE];
+	for (int j = 0; j < size; j++) {
+		memset(acc, 0, sizeof(acc));
+		const uint8_t *row = &ds->rows[(ds->v_start[j] - ds->first_row) * size];
+		for (int k = 0; k < ds->v_count[j]; k++) {
+			accumulate_row(acc, &row[k * size]);
+		}
+
+		int base;
+		int step;
+		switch (ds->rotation) {
+			case 90:
+				base = size - 1 - j;
+				step = size;
+				break;
+			case 180:
+				base = (size - 1 - j) * size + size - 1;
+				step = -1;
+				break;
+			case 270:
+				base = (size - 1) * size + j;
+				step = -size;
+				break;
+			default:
+				base = j * size;
+				step = 1;
+				break;
+		}
+		uint64_t recip = ds->v_recip[j];
+		for (int i = 0; i < size; i++) {
+			out[base + i * step] = divide(acc[i], recip);
+		}
+	}
+}
+
+void camera_downscale_destroy(struct camera_downscale *ds) {
+	free(ds->rows);
+	*ds = {};
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_CAMERA_DOWNSCALE_H
+#define GBCC_ANDROID_CAMERA_DOWNSCALE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define CAMERA_DOWNSCALE_SIZE 128
+
+/*
+ * Box-blur & nearest-neighbour downscale of a greyscale camera frame to the
+ * 128x128 Game Boy Camera sensor, with rotation applied on output.
+ *
+ * The blur is only evaluated at the pixels that survive the downscale, so the
+ * result is identical to blurring the whole frame and then sampling it.
+ * All per-geometry tables and scratch space are set up by
+ * camera_downscale_configure(), so processing a frame doesn't allocate.
+ */
+struct camera_downscale {
+	int width;
+	int height;
+	int row_stride;
+	int rotation;
+
+	/* Horizontal window (first column, length) for each sample column */
+	int h_start[CAMERA_DOWNSCALE_SIZE];
+	int h_count[CAMERA_DOWNSCALE_SIZE];
+	uint64_t h_recip[CAMERA_DOWNSCALE_SIZE];
+	bool h_simd[CAMERA_DOWNSCALE_SIZE];
+
+	/* Vertical window (first row, length) for each sample row */
+	int v_start[CAMERA_DOWNSCALE_SIZE];
+	int v_count[CAMERA_DOWNSCALE_SIZE];
+	uint64_t v_recip[CAMERA_DOWNSCALE_SIZE];
+
+	/* Horizontally blurred samples, CAMERA_DOWNSCALE_SIZE per source row */
+	int first_row;
+	int num_rows;
+	uint8_t *rows;
+	size_t rows_capacity;
+};
+
+/* Returns true if the tables need rebuilding for this frame geometry */
+bool camera_downscale_needs_configure(const struct camera_downscale *ds, int width, int height, int row_stride, int rotation);
+/* Returns false if out of memory, in which case the frame can't be run */
+bool camera_downscale_configure(struct camera_downscale *ds, int width, int height, int row_stride, int rotation);
+void camera_downscale_run(struct camera_downscale *ds, const uint8_t *image, uint8_t *out);
+void camera_downscale_destroy(struct camera_downscale *ds);
+
+#endif /* GBCC_ANDROID_CAMERA_DOWNSCALE_H */
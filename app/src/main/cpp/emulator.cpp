@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#include "emulator.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <semaphore.h>
+
+extern "C" {
+#include <audio.h>
+#include <core.h>
+}
+
+/* The Game Boy's frame period, exactly */
+#define GB_FRAME_SECONDS (70224.0 / 4194304.0)
+
+static thread_local struct emulator *current;
+
+static void *emulation_thread(void *arg) {
+	auto *emu = static_cast<struct emulator *>(arg);
+	current = emu;
+	return gbcc_emulation_loop(&emu->gbc);
+}
+
+/* Emulation thread */
+static void frame_boundary(struct emulator *emu) {
+	struct emulator_frame *frame = &emu->published[triple_buffer_back(&emu->exchange)];
+	frame->number = emu->boundaries++;
+	memcpy(frame->pixels, emu->gbc.core.ppu.screen.sdl, sizeof(frame->pixels));
+	triple_buffer_publish(&emu->exchange);
+	if (emu->on_frame != nullptr) {
+		emu->on_frame(emu);
+	}
+}
+
+#ifdef GBCC_FRAME_HOOK
+extern "C" int __real_sem_wait(sem_t *sem);
+
+/* Every sem_wait in the target comes through here, see struct emulator */
+extern "C" int __wrap_sem_wait(sem_t *sem) {
+	struct emulator *emu = current;
+	if (emu == nullptr || sem != &emu->gbc.core.ppu.vsync_semaphore) {
+		return __real_sem_wait(sem);
+	}
+	frame_boundary(emu);
+	emu->frames.fetch_add(1, std::memory_order_release);
+	sem_post(&emu->frame_done);
+
+	struct timespec start{};
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	emu->parked.store(true);
+	int ret = __real_sem_wait(sem);
+	emu->parked.store(false);
+	if (emu->on_vsync_wait != nullptr) {
+		struct timespec end{};
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		int64_t ns = (end.tv_sec - start.tv_sec) * INT64_C(1000000000) + (end.tv_nsec - start.tv_nsec);
+		emu->on_vsync_wait(emu, static_cast<uint64_t>(ns) / 1000u);
+	}
+	// Both flags are sequentially consistent, so either the renderer sees
+	// we've left the wait, or we see it holding us and block until it's done
+	if (emu->held.load()) {
+		pthread_mutex_lock(&emu->hold_lock);
+		pthread_mutex_unlock(&emu->hold_lock);
+	}
+	return ret;
+}
+#endif
+
+struct emulator *emulator_create() {
+	// Value-initialised, so the core starts out zeroed as it expects
+	auto *emu = new emulator();
+	sem_init(&emu->frame_done, 0, 0);
+	pthread_mutex_init(&emu->hold_lock, nullptr);
+	return emu;
+}
+
+void emulator_destroy(struct emulator *emu) {
+	if (emu == nullptr) {
+		return;
+	}
+	emulator_stop(emu);
+	if (emu->loaded) {
+		gbcc_free(&emu->gbc.core);
+		gbcc_audio_destroy(&emu->gbc);
+	}
+	free(emu->rom);
+	sem_destroy(&emu->frame_done);
+	pthread_mutex_destroy(&emu->hold_lock);
+	delete emu;
+}
+
+bool emulator_load(struct emulator *emu, const char *rom, unsigned int sample_rate, unsigned int samples_per_buffer) {
+	if (emu->loaded) {
+		return false;
+	}
+	gbcc_initialise(&emu->gbc.core, rom);
+	if (!emu->gbc.core.initialised) {
+		return false;
+	}
+	emu->rom = strdup(rom);
+	emu->gbc.quit = false;
+	emu->gbc.has_focus = true;
+	gbcc_audio_initialise(&emu->gbc, sample_rate, samples_per_buffer);
+	emu->loaded = true;
+	return true;
+}
+
+const char *emulator_error(const struct emulator *emu) {
+	return emu->gbc.core.error_msg;
+}
+
+bool emulator_run(struct emulator *emu) {
+	if (!emu->loaded || emu->running) {
+		return false;
+	}
+	emu->frames.store(0);
+	emu->frames_stepped = 0;
+	emu->boundaries = 0;
+	emu->unsynced_seconds = 0;
+	if (pthread_create(&emu->thread, nullptr, emulation_thread, emu) != 0) {
+		return false;
+	}
+	emu->running = true;
+	return true;
+}
+
+void emulator_stop(struct emulator *emu) {
+	if (!emu->running) {
+		return;
+	}
+	emu->gbc.quit = true;
+	sem_post(&emu->gbc.core.ppu.vsync_semaphore);
+	pthread_join(emu->thread, nullptr);
+	emu->running = false;
+}
+
+bool emulator_step_frames(struct emulator *emu, unsigned int frames) {
+#ifndef GBCC_FRAME_HOOK
+	(void) emu;
+	(void) frames;
+	return false;
+#else
+	if (!emu->running) {
+		return false;
+	}
+	sem_t *vsync = &emu->gbc.core.ppu.vsync_semaphore;
+	emu->frames_stepped += frames;
+	for (unsigned int i = 0; i < frames; i++) {
+		sem_post(vsync);
+	}
+	// The thread runs its first frame before waiting on any vsync, so the
+	// last frame asked for ends at vsync wait number frames_stepped + 1.
+	// Any posts left over from earlier waits just go round the loop again.
+	while (emu->frames.load(std::memory_order_acquire) <= emu->frames_stepped) {
+		// Every frame completed restarts the timeout, so only a missing hook trips it
+		struct timespec deadline{};
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += EMULATOR_STEP_TIMEOUT;
+		if (sem_timedwait(&emu->frame_done, &deadline) != 0 && errno == ETIMEDOUT) {
+			return false;
+		}
+	}
+	return true;
+#endif
+}
+
+void emulator_advance(struct emulator *emu, double seconds) {
+	if (emu->gbc.core.sync_to_video) {
+		emu->unsynced_seconds = 0;
+		return;
+	}
+	emu->unsynced_seconds += seconds;
+	if (emu->unsynced_seconds >= GB_FRAME_SECONDS) {
+		emu->unsynced_seconds = fmod(emu->unsynced_seconds, GB_FRAME_SECONDS);
+		frame_boundary(emu);
+	}
+}
+
+const struct emulator_frame *emulator_acquire_frame(struct emulator *emu, bool *fresh) {
+	return &emu->published[triple_buffer_acquire_fresh(&emu->exchange, fresh)];
+}
+
+bool emulator_hold(struct emulator *emu) {
+	pthread_mutex_lock(&emu->hold_lock);
+	emu->held.store(true);
+	if (!emu->parked.load()) {
+		emu->held.store(false);
+		pthread_mutex_unlock(&emu->hold_lock);
+		return false;
+	}
+	return true;
+}
+
+void emulator_release(struct emulator *emu) {
+	emu->held.store(false);
+	pthread_mutex_unlock(&emu->hold_lock);
+}
+
+const uint32_t *emulator_get_framebuffer(const struct emulator *emu) {
+	return emu->gbc.core.ppu.screen.sdl;
+}
+
+struct emulator *emulator_current() {
+	return current;
+}
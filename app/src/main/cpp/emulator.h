@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_EMULATOR_H
+#define GBCC_ANDROID_EMULATOR_H
+
+#include <atomic>
+#include <cstdint>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "input_queue.h"
+#include "triple_buffer.h"
+
+extern "C" {
+#include <gbcc.h>
+}
+
+#define EMULATOR_FRAME_PIXELS (GBCC_SCREEN_WIDTH * GBCC_SCREEN_HEIGHT)
+#define EMULATOR_STEP_TIMEOUT 10
+
+struct emulator_frame {
+	uint64_t number;  /* Frame boundaries before this one since emulator_run */
+	uint32_t pixels[EMULATOR_FRAME_PIXELS];
+};
+
+/*
+ * One emulator instance: a core and the thread running it. Nothing here is
+ * process-wide, so any number of instances can run at once, each on its own
+ * thread.
+ *
+ * Platform callbacks made by the core run on the emulation thread, and can
+ * find their instance with emulator_current().
+ *
+ * The core's vsync wait is the frame boundary. The core has no callback
+ * there, so targets that want one opt in with gbcc_frame_hook() in
+ * CMakeLists.txt, which defines GBCC_FRAME_HOOK and links with
+ * -Wl,--wrap=sem_wait. Then each time the emulation thread is about to wait
+ * on its instance's vsync_semaphore it first publishes the completed frame,
+ * calls on_frame if set, then counts the frame and posts frame_done. Waits
+ * on any other semaphore, or from any other thread, go straight through.
+ *
+ * The wrap only sees sem_wait calls linked into the same target, so it
+ * relies on the core being compiled in, and waiting with plain sem_wait.
+ * Should either change, frame boundaries stop: emulator_step_frames() then
+ * fails rather than hanging, and the app logs a warning.
+ *
+ * Without sync to video the core never waits, so frame boundaries come from
+ * emulator_advance() instead, with or without the hook.
+ */
+struct emulator {
+	struct gbcc gbc;
+	char *rom;
+	bool loaded;
+	bool running;
+	pthread_t thread;
+
+	/* Frames completed, and a post for each, see emulator_step_frames() */
+	std::atomic<uint64_t> frames;
+	sem_t frame_done;
+	uint64_t frames_stepped;
+
+	/* Emulation thread, at each frame boundary */
+	void (*on_frame)(struct emulator *emu);
+	/* Emulation thread, after each vsync wait, with how long it blocked */
+	void (*on_vsync_wait)(struct emulator *emu, uint64_t us);
+
+	/* Completed frames for the renderer, see emulator_acquire_frame() */
+	struct emulator_frame published[3];
+	struct triple_buffer exchange;
+	uint64_t boundaries;      /* Emulation thread only */
+	double unsynced_seconds;  /* Emulation thread only */
+	/* See emulator_hold() */
+	std::atomic<bool> parked;
+	std::atomic<bool> held;
+	pthread_mutex_t hold_lock;
+
+	/* Joypad events waiting to be applied between frames */
+	struct input_queue input;
+	/* Mirror of gbc.core.keys.turbo, updated between frames & when the UI sets it */
+	std::atomic<bool> turbo;
+	/* Progress through the core's printer buffer, see GLActivity.updatePrinter */
+	int print_stage;
+};
+
+struct emulator *emulator_create();
+
+/* Stops the emulation thread if it's running, then frees everything */
+void emulator_destroy(struct emulator *emu);
+
+/* On failure, the reason is available from emulator_error() */
+bool emulator_load(struct emulator *emu, const char *rom, unsigned int sample_rate, unsigned int samples_per_buffer);
+const char *emulator_error(const struct emulator *emu);
+
+/* Start and stop the emulation thread */
+bool emulator_run(struct emulator *emu);
+void emulator_stop(struct emulator *emu);
+
+/*
+ * With gbc.core.sync_to_video set, let the emulation thread run the given
+ * number of frames, returning once it has reached the vsync wait after the
+ * last of them. Only for headless use, where nothing else is posting vsyncs.
+ *
+ * Returns false if the emulator isn't running, or no frame boundary arrives
+ * within EMULATOR_STEP_TIMEOUT seconds, as happens without the frame hook.
+ */
+bool emulator_step_frames(struct emulator *emu, unsigned int frames);
+
+/*
+ * Emulation thread: note that the core has emulated this much more time.
+ * Without sync to video this marks a frame boundary once per emulated frame
+ * period, for the platform hook the core calls regularly (the audio queue).
+ * Does nothing when synced to video, where the vsync wait marks them.
+ */
+void emulator_advance(struct emulator *emu, double seconds);
+
+/*
+ * Renderer: the newest frame published, which stays valid until the next
+ * call. fresh is set if it hasn't been returned before. Frames published
+ * but never returned are counted in exchange.dropped, and calls returning
+ * the same frame again in exchange.reused.
+ */
+const struct emulator_frame *emulator_acquire_frame(struct emulator *emu, bool *fresh);
+
+/*
+ * Renderer: the core's window code reads the core's own screen, which is
+ * only stable while the emulation thread is parked at its vsync wait. If it
+ * is parked, keep it from resuming emulation until emulator_release(), and
+ * return true. Its completed frame is then the newest one published. A
+ * thread woken in the meantime blocks on hold_lock until the release.
+ */
+bool emulator_hold(struct emulator *emu);
+void emulator_release(struct emulator *emu);
+
+/*
+ * The last completed frame, GBCC_SCREEN_WIDTH x GBCC_SCREEN_HEIGHT pixels.
+ * Only stable on the emulation thread, or while it's waiting for vsync, such
+ * as straight after emulator_step_frames().
+ */
+const uint32_t *emulator_get_framebuffer(const struct emulator *emu);
+
+/* The instance whose emulation thread this is, or nullptr */
+struct emulator *emulator_current();
+
+#endif /* GBCC_ANDROID_EMULATOR_H */
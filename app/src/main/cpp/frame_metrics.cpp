@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#include "frame_metrics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+
+#include "logger.h"
+
+/*
+ * Log-linear buckets: exact below 4us, then 4 per power of two,
+ * which keeps every bucket within 25% of its value up to ~67s.
+ */
+#define SUB_BUCKET_BITS 2u
+#define SUB_BUCKETS (1u << SUB_BUCKET_BITS)
+#define MAX_EXPONENT 26u
+#define NUM_BUCKETS (SUB_BUCKETS + (MAX_EXPONENT - SUB_BUCKET_BITS) * SUB_BUCKETS)
+
+struct histogram {
+	std::atomic<uint32_t> buckets[NUM_BUCKETS];
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> max;
+};
+
+static const char * const metric_names[FRAME_METRIC_COUNT] = {
+	"Emulation",
+	"Vsync wait",
+	"Render",
+	"Present interval",
+	"Input latency",
+	"Audio fill"
+};
+
+static struct histogram histograms[FRAME_METRIC_COUNT];
+
+/* Input latency tracking, see frame_metrics_input; the frame is written first */
+static std::atomic<uint64_t> input_time;
+static std::atomic<uint64_t> input_frame;
+
+static unsigned int bucket_index(uint64_t us) {
+	if (us < SUB_BUCKETS) {
+		return static_cast<unsigned int>(us);
+	}
+	unsigned int exponent = 63u - static_cast<unsigned int>(__builtin_clzll(us));
+	if (exponent >= MAX_EXPONENT) {
+		return NUM_BUCKETS - 1;
+	}
+	unsigned int sub = static_cast<unsigned int>(us >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+	return SUB_BUCKETS + (exponent - SUB_BUCKET_BITS) * SUB_BUCKETS + sub;
+}
+
+static uint64_t bucket_lower_bound(unsigned int bucket) {
+	if (bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+	unsigned int exponent = (bucket - SUB_BUCKETS) / SUB_BUCKETS + SUB_BUCKET_BITS;
+	uint64_t sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+	return (SUB_BUCKETS + sub) << (exponent - SUB_BUCKET_BITS);
+}
+
+uint64_t frame_metrics_now_us() {
+	struct timespec ts{};
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000u + static_cast<uint64_t>(ts.tv_nsec) / 1000u;
+}
+
+void frame_metrics_reset() {
+	for (auto &h : histograms) {
+		for (auto &b : h.buckets) {
+			b.store(0, std::memory_order_relaxed);
+		}
+		h.sum.store(0, std::memory_order_relaxed);
+		h.max.store(0, std::memory_order_relaxed);
+	}
+	input_time.store(0, std::memory_order_relaxed);
+}
+
+void frame_metrics_record(enum frame_metric metric, uint64_t us) {
+	struct histogram *h = &histograms[metric];
+	h->buckets[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+	h->sum.fetch_add(us, std::memory_order_relaxed);
+	uint64_t max = h->max.load(std::memory_order_relaxed);
+	while (us > max && !h->max.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+	}
+}
+
+void frame_metrics_input(uint64_t press_us, uint64_t frame) {
+	// Acquire, so the renderer's finished reading the last frame before it's replaced
+	if (input_time.load(std::memory_order_acquire) != 0) {
+		return;
+	}
+	// Only this thread sets input_time, so nothing can claim it in between
+	input_frame.store(frame, std::memory_order_relaxed);
+	input_time.store(press_us, std::memory_order_release);
+}
+
+void frame_metrics_present(uint64_t now_us, uint64_t frame) {
+	uint64_t t = input_time.load(std::memory_order_acquire);
+	if (t == 0 || frame < input_frame.load(std::memory_order_relaxed)) {
+		return;
+	}
+	frame_metrics_record(FRAME_METRIC_INPUT_LATENCY, now_us - t);
+	input_time.store(0, std::memory_order_release);
+}
+
+void frame_metrics_summarise(uint64_t *out) {
+	for (int m = 0; m < FRAME_METRIC_COUNT; m++) {
+		const struct histogram *h = &histograms[m];
+		uint64_t *fields = &out[m * FRAME_METRIC_NUM_FIELDS];
+
+		uint32_t counts[NUM_BUCKETS];
+		uint64_t count = 0;
+		for (unsigned int b = 0; b < NUM_BUCKETS; b++) {
+			counts[b] = h->buckets[b].load(std::memory_order_relaxed);
+			count += counts[b];
+		}
+		uint64_t max = h->max.load(std::memory_order_relaxed);
+		fields[FRAME_METRIC_FIELD_COUNT] = count;
+		fields[FRAME_METRIC_FIELD_MEAN] = count > 0 ? h->sum.load(std::memory_order_relaxed) / count : 0;
+		fields[FRAME_METRIC_FIELD_MAX] = max;
+
+		static const struct {
+			enum frame_metric_field field;
+			uint64_t permille;
+		} percentiles[] = {
+			{FRAME_METRIC_FIELD_P50, 500},
+			{FRAME_METRIC_FIELD_P90, 900},
+			{FRAME_METRIC_FIELD_P99, 990}
+		};
+		for (const auto &p : percentiles) {
+			/* Report the upper edge of the bucket the percentile lands in */
+			uint64_t target = (count * p.permille + 999) / 1000;
+			uint64_t seen = 0;
+			uint64_t value = 0;
+			for (unsigned int b = 0; b < NUM_BUCKETS && count > 0; b++) {
+				seen += counts[b];
+				if (seen >= target) {
+					value = b + 1 < NUM_BUCKETS ? bucket_lower_bound(b + 1) - 1 : max;
+					break;
+				}
+			}
+			fields[p.field] = std::min(value, max);
+		}
+	}
+}
+
+void frame_metrics_log() {
+	uint64_t summary[FRAME_METRIC_COUNT * FRAME_METRIC_NUM_FIELDS];
+	frame_metrics_summarise(summary);
+	logger_print(LOGGER_INFO, "%-17s %8s %8s %8s %8s %8s %8s",
+			"Frame metric (us)", "Count", "Mean", "p50", "p90", "p99", "Max");
+	for (int m = 0; m < FRAME_METRIC_COUNT; m++) {
+		const uint64_t *f = &summary[m * FRAME_METRIC_NUM_FIELDS];
+		logger_print(LOGGER_INFO, "%-17s %8llu %8llu %8llu %8llu %8llu %8llu",
+				metric_names[m],
+				static_cast<unsigned long long>(f[FRAME_METRIC_FIELD_COUNT]),
+				static_cast<unsigned long long>(f[FRAME_METRIC_FIELD_MEAN]),
+				static_cast<unsigned long long>(f[FRAME_METRIC_FIELD_P50]),
+				static_cast<unsigned long long>(f[FRAME_METRIC_FIELD_P90]),
+				static_cast<unsigned long long>(f[FRAME_METRIC_FIELD_P99]),
+				static_cast<unsigned long long>(f[FRAME_METRIC_FIELD_MAX]));
+	}
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_FRAME_METRICS_H
+#define GBCC_ANDROID_FRAME_METRICS_H
+
+#include <cstdint>
+
+/*
+ * Per-frame timing histograms, all in microseconds.
+ *
+ * Metrics are recorded from whichever thread sees the event: the render
+ * thread per present, the emulation thread per vsync wait, and the audio
+ * device per buffer. Recording is just a few relaxed atomic adds.
+ */
+enum frame_metric {
+	FRAME_METRIC_EMULATION,        /* Emulation thread CPU time per present */
+	FRAME_METRIC_VSYNC_WAIT,       /* Emulation thread blocked in the core's vsync wait */
+	FRAME_METRIC_RENDER,           /* Time spent in gbcc_window_update */
+	FRAME_METRIC_PRESENT_INTERVAL,
+	FRAME_METRIC_INPUT_LATENCY,    /* press() to the first frame emulated with it being presented */
+	FRAME_METRIC_AUDIO_FILL,       /* Audio buffered ahead of the device, each time it takes a buffer */
+	FRAME_METRIC_COUNT
+};
+
+/* Fields per metric in frame_metrics_summarise's output */
+enum frame_metric_field {
+	FRAME_METRIC_FIELD_COUNT,
+	FRAME_METRIC_FIELD_MEAN,
+	FRAME_METRIC_FIELD_P50,
+	FRAME_METRIC_FIELD_P90,
+	FRAME_METRIC_FIELD_P99,
+	FRAME_METRIC_FIELD_MAX,
+	FRAME_METRIC_NUM_FIELDS
+};
+
+uint64_t frame_metrics_now_us();
+void frame_metrics_reset();
+void frame_metrics_record(enum frame_metric metric, uint64_t us);
+
+/*
+ * Emulation thread: note a joypad press made at press_us, applied before
+ * frame number frame, if one isn't already being tracked
+ */
+void frame_metrics_input(uint64_t press_us, uint64_t frame);
+/* Render thread: note a present, completing the tracked input's latency if its frame is shown */
+void frame_metrics_present(uint64_t now_us, uint64_t frame);
+
+/* Write FRAME_METRIC_COUNT * FRAME_METRIC_NUM_FIELDS values to out */
+void frame_metrics_summarise(uint64_t *out);
+void frame_metrics_log();
+
+#endif /* GBCC_ANDROID_FRAME_METRICS_H */
@@ -13,17 +13,32 @@
 #include <GLES3/gl3.h>
 #include <GLES3/gl3ext.h>
 
+#include <atomic>
 #include <string>
+#include <vector>
 #include <cmath>
-#include <android/log.h>
+#include <android/looper.h>
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
+#include "audio_output.h"
+#include "camera_downscale.h"
+#include "emulator.h"
+#include "frame_metrics.h"
+#include "logger.h"
+#include "recorder.h"
+#include "rom_header.h"
+#include "rom_library.h"
+#include "screenshot_writer.h"
+#include "triple_buffer.h"
+
 extern "C" {
 #pragma GCC visibility push(hidden)
 #include <gbcc.h>
-#include <bit_utils.h>
 #include <camera.h>
 #include <config.h>
 #include <core.h>
@@ -33,11 +48,36 @@ extern "C" {
 #pragma GCC visibility pop
 }
 
-#define PRINTER_STRIP_BYTES (8 * PRINTER_WIDTH_TILES * PRINTER_STRIP_HEIGHT)
+#define PRINTER_LINE_BYTES (8 * PRINTER_WIDTH_TILES)
+#define PRINTER_STRIP_BYTES (PRINTER_LINE_BYTES * PRINTER_STRIP_HEIGHT)
+/* Address space reserved for the printout, only touched pages use memory */
+#define PRINTER_IMAGE_MAX_BYTES (32 * 1024 * 1024)
 #define MAX_SHADER_LEN 32
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
+/*
+ * Emulator status passed to GLActivity.onEmulatorEvents(), which has a
+ * matching set of constants. The low byte is the current state, the next
+ * byte which state bits have changed since the last delivery, and the
+ * upper bits one-off events.
+ */
+#define EMULATOR_STATE_TURBO (1u << 0u)
+#define EMULATOR_STATE_PRINTER_CONNECTED (1u << 1u)
+#define EMULATOR_STATE_PRINTING (1u << 2u)
+#define EMULATOR_STATE_RUMBLE (1u << 3u)
+#define EMULATOR_STATE_ERROR (1u << 4u)
+#define EMULATOR_CHANGED_SHIFT 8u
+#define EMULATOR_EVENT_START_PRINTING (1u << 16u)
+#define EMULATOR_EVENT_REFRESH (1u << 17u)
+/* How long without a frame boundary before the renderer checks the state itself */
+#define STATE_STALL_US 100000
+#define FRAME_HOOK_WAIT_US 2000000
+/* GLActivity key codes below this go to the core through process_key() */
+#define NUM_CORE_KEYS 19
+/* Of which these are the joypad, applied between frames through the input queue */
+#define NUM_JOYPAD_KEYS 8
+
 /* Options to be persisted across device rotation etc. */
 struct gbcc_temp_options {
 	/* Have these options been set? */
@@ -67,26 +107,88 @@ struct gbcc_temp_options {
 	char shader[MAX_SHADER_LEN];
 };
 
-static pthread_t emu_thread;
-static struct gbcc gbc;
-static char *fname;
+/*
+ * Everything from here to the printer LUT is a process singleton.
+ * Per-instance state lives in struct emulator; what's here belongs to the
+ * one activity, surface, camera or UI the process has, and so to whichever
+ * emulator is displayed. The screenshot writer & recorder are likewise
+ * process-wide, and only fed by the renderer.
+ */
+static char rom_error[ROM_HEADER_ERROR_LEN];
 static char shader[MAX_SHADER_LEN];
 static struct gbcc_fontmap fontmap;
-static uint8_t camera_image[GB_CAMERA_SENSOR_SIZE];
-static pthread_mutex_t render_mutex = PTHREAD_MUTEX_INITIALIZER; //NOLINT
+/*
+ * Written by the camera analyzer thread, read by the emulation thread.
+ * There's only one camera, so this feeds whichever emulator is running.
+ */
+static uint8_t camera_image[3][GB_CAMERA_SENSOR_SIZE];
+static struct triple_buffer camera_buffer;
+static struct camera_downscale camera_ds;
+/* Held by the camera's analyser thread while it uses camera_ds, and by quit */
+static pthread_mutex_t camera_lock = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * Java holds each emulator as an opaque handle, but there's only one
+ * surface, which shows whichever emulator is displayed. The renderer only
+ * touches it while rendering is set, so teardown can clear displayed then
+ * wait for rendering to drop, without the renderer ever taking a lock.
+ */
+static std::atomic<struct emulator *> displayed;
+static std::atomic<bool> rendering;
+static int window_width;
+static int window_height;
+/* Renders of a newly published frame, of the same frame again, and with no emulator */
+static std::atomic<uint64_t> frames_presented;
+static std::atomic<uint64_t> frames_repeated;
+static std::atomic<uint64_t> frames_skipped;
+/* Set by the screenshot key, taken by the renderer at the next frame */
+static std::atomic<bool> screenshot_requested;
+/* Likewise for starting & stopping a recording, which the renderer feeds */
+static std::atomic<bool> recording_toggle_requested;
+/* Render thread only, the number of the next frame the recording expects */
+static uint64_t next_recorded_frame;
+/* Render thread only, for the frame metrics */
+static clockid_t emu_clock;
+static uint64_t last_present_us;
+static uint64_t last_emu_cpu_us;
+/* Render thread only, frames published when it last saw one, and when */
+static uint64_t last_published;
+static uint64_t last_published_us;
+static bool frame_hook_warned;
+/* The activity's options, persisted across device rotation */
 static struct gbcc_temp_options options;
-static FILE *logfile;
-int stdout_fd;
-int stderr_fd;
-static bool start_printing;
 
-static uint8_t print_buffer[PRINTER_STRIP_BYTES];
-static int print_stage = 0;
-static bool print_strip_done = false;
+/* Emulator -> UI event channel for the one activity, see EMULATOR_STATE_* */
+static std::atomic<uint32_t> emulator_state;
+static std::atomic<uint32_t> emulator_pending;
+static int emulator_event_fd = -1;
+static JavaVM *java_vm;
+static jobject event_listener;
+static jmethodID event_method;
 
+/*
+ * The printout shown by the activity so far, one byte per pixel. This lives
+ * at a fixed address so Java can hold direct ByteBuffers over it without
+ * them going stale.
+ */
+static uint8_t *printer_image;
+static size_t printer_image_length;
 
+/* 2bpp -> 8bpp lookup, indexed by (hi nibble << 4) | lo nibble */
+static uint8_t printer_lut[256][4];
+static uint8_t printer_lut_colours[4];
+static bool printer_lut_valid = false;
+
+
+static uint8_t *printer_image_extend(size_t bytes);
+static void update_printer_lut(struct printer *p);
 static bool print_margin(struct printer *p, bool top);
 static bool print_strip(struct printer *p);
+static void publish_emulator_events(uint32_t pending);
+static void update_emulator_state(struct emulator *emu);
+
+static inline struct emulator *from_handle(jlong handle) {
+	return reinterpret_cast<struct emulator *>(handle);
+}
 
 /*
  * Seems that the JNI doesn't guarantee strings from GetStringUTFChars are null-terminated,
@@ -105,7 +207,7 @@ char * get_utf_string(JNIEnv *env, jstring string) {
 	return buffer;
 }
 
-void update_preferences(JNIEnv *env, jobject prefs) {
+void update_preferences(JNIEnv *env, struct gbcc *gbc, jobject prefs) {
 	jstring ret;
 	jstring arg;
 	jmethodID id;
@@ -113,27 +215,27 @@ void update_preferences(JNIEnv *env, jobject prefs) {
 
 	id = env->GetMethodID(prefsClass, "getBoolean", "(Ljava/lang/String;Z)Z");
 	arg = env->NewStringUTF("auto_resume");
-	gbc.autoresume = env->CallBooleanMethod(prefs, id, arg, false);
+	gbc->autoresume = env->CallBooleanMethod(prefs, id, arg, false);
 	env->DeleteLocalRef(arg);
 	arg = env->NewStringUTF("auto_save");
-	gbc.autosave = env->CallBooleanMethod(prefs, id, arg, false);
+	gbc->autosave = env->CallBooleanMethod(prefs, id, arg, false);
 	env->DeleteLocalRef(arg);
 	arg = env->NewStringUTF("frame_blend");
-	gbc.frame_blending = env->CallBooleanMethod(prefs, id, arg, false);
+	gbc->frame_blending = env->CallBooleanMethod(prefs, id, arg, false);
 	env->DeleteLocalRef(arg);
 	arg = env->NewStringUTF("vsync");
-	gbc.core.sync_to_video = env->CallBooleanMethod(prefs, id, arg, false);
+	gbc->core.sync_to_video = env->CallBooleanMethod(prefs, id, arg, false);
 	env->DeleteLocalRef(arg);
 	arg = env->NewStringUTF("interlacing");
-	gbc.interlacing = env->CallBooleanMethod(prefs, id, arg, false);
+	gbc->interlacing = env->CallBooleanMethod(prefs, id, arg, false);
 	env->DeleteLocalRef(arg);
 	arg = env->NewStringUTF("show_fps");
-	gbc.show_fps = env->CallBooleanMethod(prefs, id, arg, false);
+	gbc->show_fps = env->CallBooleanMethod(prefs, id, arg, false);
 	env->DeleteLocalRef(arg);
 
 	id = env->GetMethodID(prefsClass, "getInt", "(Ljava/lang/String;I)I");
 	arg = env->NewStringUTF("audio_volume");
-	gbc.audio.volume = env->CallIntMethod(prefs, id, arg, 100) / 100.0f;
+	gbc->audio.volume = env->CallIntMethod(prefs, id, arg, 100) / 100.0f;
 	env->DeleteLocalRef(arg);
 
 	id = env->GetMethodID(prefsClass, "getString", "(Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;");
@@ -141,7 +243,16 @@ void update_preferences(JNIEnv *env, jobject prefs) {
 	ret = (jstring)env->CallObjectMethod(prefs, id, arg, NULL);
 	if (ret != nullptr) {
 	    char *tmp = get_utf_string(env, ret);
-		gbc.turbo_speed = static_cast<float>(strtod(tmp, nullptr));
+		gbc->turbo_speed = static_cast<float>(strtod(tmp, nullptr));
+		free(tmp);
+	}
+	env->DeleteLocalRef(arg);
+
+	arg = env->NewStringUTF("screenshot_scale");
+	ret = (jstring)env->CallObjectMethod(prefs, id, arg, NULL);
+	if (ret != nullptr) {
+		char *tmp = get_utf_string(env, ret);
+		screenshot_set_scale(static_cast<unsigned int>(strtoul(tmp, nullptr, 10)));
 		free(tmp);
 	}
 	env->DeleteLocalRef(arg);
@@ -150,12 +261,12 @@ void update_preferences(JNIEnv *env, jobject prefs) {
 	ret = (jstring)env->CallObjectMethod(prefs, id, arg, NULL);
 	if (ret != nullptr) {
 		char *tmp = get_utf_string(env, ret);
-		gbc.core.ppu.palette = gbcc_get_palette(tmp);
+		gbc->core.ppu.palette = gbcc_get_palette(tmp);
 		free(tmp);
 	}
 	env->DeleteLocalRef(arg);
 
-	if (gbc.core.mode == GBC) {
+	if (gbc->core.mode == GBC) {
 		arg = env->NewStringUTF("shader_gbc");
 	} else {
 		arg = env->NewStringUTF("shader_dmg");
@@ -163,7 +274,7 @@ void update_preferences(JNIEnv *env, jobject prefs) {
 	ret = (jstring)env->CallObjectMethod(prefs, id, arg, NULL);
 
 	if (ret == nullptr) {
-		if (gbc.core.mode == GBC) {
+		if (gbc->core.mode == GBC) {
 			strncpy(shader, "Subpixel", MAX_SHADER_LEN);
 		} else {
 			strncpy(shader, "Dot Matrix", MAX_SHADER_LEN);
@@ -177,41 +288,190 @@ void update_preferences(JNIEnv *env, jobject prefs) {
 	env->DeleteLocalRef(prefsClass);
 }
 
-void logfile_begin() {
-	// Redirect stdout & stderr to a log file, storing old fd's for later restoration
-	stdout_fd = dup(fileno(stdout));
-	stderr_fd = dup(fileno(stderr));
-	logfile = freopen("gbcc.log", "w", stdout);
-	dup2(fileno(stdout), fileno(stderr));
+static void record_frame_metrics(uint64_t start, uint64_t end, uint64_t frame) {
+	frame_metrics_record(FRAME_METRIC_RENDER, end - start);
+	frame_metrics_present(end, frame);
+
+	// Once the emulation thread has exited its clock is gone, so this can fail
+	struct timespec ts;  // NOLINT
+	uint64_t emu_cpu_us = 0;
+	if (clock_gettime(emu_clock, &ts) == 0) {
+		emu_cpu_us = static_cast<uint64_t>(ts.tv_sec) * 1000000u + static_cast<uint64_t>(ts.tv_nsec) / 1000u;
+	}
+	if (last_present_us != 0) {
+		uint64_t interval = start - last_present_us;
+		frame_metrics_record(FRAME_METRIC_PRESENT_INTERVAL, interval);
+		if (emu_cpu_us != 0 && last_emu_cpu_us != 0) {
+			frame_metrics_record(FRAME_METRIC_EMULATION, emu_cpu_us - last_emu_cpu_us);
+		}
+	}
+	last_present_us = start;
+	last_emu_cpu_us = emu_cpu_us;
 }
 
-void logfile_end() {
-	// Restore stdout & stderr
-	dup2(stdout_fd, fileno(stdout));
-	dup2(stderr_fd, fileno(stderr));
-	close(stdout_fd);
-	close(stderr_fd);
-	fclose(logfile);
-	logfile = nullptr;
+static void process_key(struct gbcc *gbc, int key, bool pressed) {
+	switch (key) {
+		case 0:
+			gbcc_input_process_key(gbc, GBCC_KEY_A, pressed);
+			break;
+		case 1:
+			gbcc_input_process_key(gbc, GBCC_KEY_B, pressed);
+			break;
+		case 2:
+			gbcc_input_process_key(gbc, GBCC_KEY_START, pressed);
+			break;
+		case 3:
+			gbcc_input_process_key(gbc, GBCC_KEY_SELECT, pressed);
+			break;
+		case 4:
+			gbcc_input_process_key(gbc, GBCC_KEY_UP, pressed);
+			break;
+		case 5:
+			gbcc_input_process_key(gbc, GBCC_KEY_DOWN, pressed);
+			break;
+		case 6:
+			gbcc_input_process_key(gbc, GBCC_KEY_LEFT, pressed);
+			break;
+		case 7:
+			gbcc_input_process_key(gbc, GBCC_KEY_RIGHT, pressed);
+			break;
+		case 8:
+			gbcc_input_process_key(gbc, GBCC_KEY_TURBO, pressed);
+			break;
+		case 9:
+			gbcc_input_process_key(gbc, GBCC_KEY_PAUSE, pressed);
+			break;
+		case 10:
+			gbcc_input_process_key(gbc, GBCC_KEY_PRINTER, pressed);
+			break;
+		case 11:
+			gbcc_input_process_key(gbc, GBCC_KEY_FPS, pressed);
+			break;
+		case 12:
+			gbcc_input_process_key(gbc, GBCC_KEY_FRAME_BLENDING, pressed);
+			break;
+		case 13:
+			gbcc_input_process_key(gbc, GBCC_KEY_VSYNC, pressed);
+			break;
+		case 14:
+			gbcc_input_process_key(gbc, GBCC_KEY_LINK_CABLE, pressed);
+			break;
+		case 15:
+			gbcc_input_process_key(gbc, GBCC_KEY_AUTOSAVE, pressed);
+			break;
+		case 16:
+			gbcc_input_process_key(gbc, GBCC_KEY_MENU, pressed);
+			break;
+		case 17:
+			gbcc_input_process_key(gbc, GBCC_KEY_INTERLACE, pressed);
+			break;
+		case 18:
+			gbcc_input_process_key(gbc, GBCC_KEY_SHADER, pressed);
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Emulation thread, at each frame boundary, so joypad keys change between
+ * frames rather than part way through one, whatever the sync mode, and each
+ * event is first seen by the frame after its timestamp. A press & release
+ * within one frame would never be seen, so the release is held back a frame.
+ */
+static void apply_input(struct emulator *emu) {
+	uint64_t now = frame_metrics_now_us();
+	uint32_t pressed = 0;
+	const struct queued_key *event;
+	while ((event = input_queue_peek(&emu->input)) != nullptr && event->time_us <= now) {
+		if (event->key < 0 || event->key >= NUM_JOYPAD_KEYS) {
+			input_queue_pop(&emu->input);
+			continue;
+		}
+		uint32_t bit = 1u << static_cast<uint32_t>(event->key);
+		if (!event->pressed && (pressed & bit)) {
+			break;
+		}
+		if (event->pressed) {
+			pressed |= bit;
+		}
+		process_key(&emu->gbc, event->key, event->pressed);
+		// Input latency ends when the next frame is shown
+		if (event->pressed && emu == displayed.load(std::memory_order_relaxed)) {
+			frame_metrics_input(event->time_us, emu->boundaries);
+		}
+		input_queue_pop(&emu->input);
+	}
+	emu->turbo.store(emu->gbc.core.keys.turbo, std::memory_order_relaxed);
+}
+
+/* Emulation thread, at each frame boundary */
+static void between_frames(struct emulator *emu) {
+	apply_input(emu);
+	// The core's state is only stable here, so this is where we notice changes
+	if (emu == displayed.load(std::memory_order_relaxed)) {
+		update_emulator_state(emu);
+	}
+}
+
+/* Emulation thread, see struct emulator */
+static void record_vsync_wait(struct emulator *emu, uint64_t us) {
+	if (emu == displayed.load(std::memory_order_relaxed)) {
+		frame_metrics_record(FRAME_METRIC_VSYNC_WAIT, us);
+	}
+}
+
+/* Screenshots & recordings go in the files directory, named after the ROM */
+static std::string rom_name(const struct emulator *emu) {
+	const char *base = strrchr(emu->rom, '/');
+	std::string name = (base != nullptr) ? base + 1 : emu->rom;
+	return name.substr(0, name.rfind('.'));
+}
+
+/* Render thread, or once it's stopped */
+static void end_recording() {
+	if (!recorder_active()) {
+		return;
+	}
+	recorder_end();
+	struct recorder_stats stats = recorder_get_stats();
+	logger_print(LOGGER_INFO, "Recording: %llu frames written, %llu dropped",
+			static_cast<unsigned long long>(stats.frames_written),
+			static_cast<unsigned long long>(stats.frames_dropped));
+}
+
+/* Render thread only, with rendering set */
+static void window_initialise(struct emulator *emu) {
+	struct gbcc *gbc = &emu->gbc;
+	gbc->window.width = window_width;
+	gbc->window.height = window_height;
+	gbcc_window_initialise(gbc);
+	gbcc_window_use_shader(gbc, shader);
+	if (!gbc->menu.initialised) {
+		gbcc_menu_init(gbc);
+		if (options.initialised && options.menu_initialised) {
+			gbc->menu.show = options.show;
+			gbc->menu.save_state = options.save_state;
+			gbc->menu.load_state = options.load_state;
+			gbc->menu.selection = options.selection;
+		}
+	}
+	if (options.initialised) {
+		gbcc_window_use_shader(gbc, options.shader);
+	}
+	gbcc_menu_update(gbc);
 }
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_philj56_gbcc_MyGLRenderer_initWindow(
 		JNIEnv *,
 		jobject) {
-	gbcc_window_initialise(&gbc);
-	gbcc_window_use_shader(&gbc, shader);
-	gbcc_menu_init(&gbc);
-	if (options.initialised) {
-		if (options.menu_initialised) {
-			gbc.menu.show = options.show;
-			gbc.menu.save_state = options.save_state;
-			gbc.menu.load_state = options.load_state;
-			gbc.menu.selection = options.selection;
-		}
-		gbcc_window_use_shader(&gbc, options.shader);
+	rendering.store(true);
+	struct emulator *emu = displayed.load();
+	if (emu != nullptr) {
+		window_initialise(emu);
 	}
-	gbcc_menu_update(&gbc);
+	rendering.store(false);
 }
 
 
@@ -219,12 +479,17 @@ extern "C" JNIEXPORT void JNICALL
 Java_com_philj56_gbcc_MyGLSurfaceView_destroyWindow(
 		JNIEnv *,
 		jobject) {
-	if (gbc.menu.initialised) {
-		gbcc_menu_destroy(&gbc);
+	// Called on the UI thread, which is also the only one to free emulators
+	struct emulator *emu = displayed.load();
+	if (emu == nullptr) {
+		return;
 	}
-	if (gbc.window.initialised) {
+	if (emu->gbc.menu.initialised) {
+		gbcc_menu_destroy(&emu->gbc);
+	}
+	if (emu->gbc.window.initialised) {
 		// Have to destroy the window manually, as the OpenGL context is likely to be gone by now
-		gbc.window.initialised = false;
+		emu->gbc.window.initialised = false;
 	}
 }
 
@@ -232,16 +497,66 @@ extern "C" JNIEXPORT void JNICALL
 Java_com_philj56_gbcc_MyGLRenderer_updateWindow(
 		JNIEnv *,
 		jobject) {
-	if (pthread_mutex_trylock(&render_mutex) != 0) {
-		return;
-	}
-	if (gbc.core.initialised) {
-		if (!gbc.window.initialised) {
-			gbcc_window_initialise(&gbc);
+	rendering.store(true);
+	struct emulator *emu = displayed.load();
+	if (emu != nullptr) {
+		uint64_t start = frame_metrics_now_us();
+		if (!emu->gbc.window.initialised) {
+			// The surface can come up before the emulator is displayed
+			window_initialise(emu);
+		}
+		uint64_t published = emu->exchange.published.load(std::memory_order_relaxed);
+		if (published != last_published || last_published_us == 0) {
+			last_published = published;
+			last_published_us = start;
+		} else if (start - last_published_us >= STATE_STALL_US) {
+			// Paused or otherwise not reaching frame boundaries, where the
+			// state is normally checked, so the UI would never hear of changes
+			update_emulator_state(emu);
+			if (published == 0 && !frame_hook_warned && start - last_published_us >= FRAME_HOOK_WAIT_US) {
+				// See struct emulator, nothing will ever be published
+				logger_print(LOGGER_WARNING, "No frame boundaries, the core's vsync wait isn't reaching the frame hook");
+				frame_hook_warned = true;
+			}
+		}
+		bool fresh;
+		const struct emulator_frame *frame = emulator_acquire_frame(emu, &fresh);
+		if (screenshot_requested.exchange(false)) {
+			screenshot_capture(frame->pixels);
+		}
+		if (recording_toggle_requested.exchange(false)) {
+			if (recorder_active()) {
+				end_recording();
+			} else if (recorder_begin("recordings", rom_name(emu).c_str(), audio_output_sample_rate())) {
+				// Start from the frame on screen, or the one after if it's been recorded already
+				next_recorded_frame = frame->number + (fresh ? 0 : 1);
+				logger_print(LOGGER_INFO, "Recording started");
+			}
+		}
+		if (fresh && recorder_active()) {
+			// Frames published while the renderer was busy never reach it, so
+			// the recording repeats the last one over them to keep time
+			if (frame->number > next_recorded_frame) {
+				recorder_skip_frames(frame->number - next_recorded_frame);
+			}
+			recorder_push_frame(frame->pixels);
+			next_recorded_frame = frame->number + 1;
+		}
+		bool held = emulator_hold(emu);
+		gbcc_window_update(&emu->gbc);
+		if (held) {
+			emulator_release(emu);
 		}
-		gbcc_window_update(&gbc);
+		record_frame_metrics(start, frame_metrics_now_us(), frame->number);
+		if (fresh) {
+			frames_presented.fetch_add(1, std::memory_order_relaxed);
+		} else {
+			frames_repeated.fetch_add(1, std::memory_order_relaxed);
+		}
+	} else {
+		frames_skipped.fetch_add(1, std::memory_order_relaxed);
 	}
-	pthread_mutex_unlock(&render_mutex);
+	rendering.store(false);
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -250,8 +565,15 @@ Java_com_philj56_gbcc_MyGLRenderer_resizeWindow(
 		jobject,
 		jint width,
 		jint height) {
-	gbc.window.width = width;
-	gbc.window.height = height;
+	window_width = width;
+	window_height = height;
+	rendering.store(true);
+	struct emulator *emu = displayed.load();
+	if (emu != nullptr) {
+		emu->gbc.window.width = width;
+		emu->gbc.window.height = height;
+	}
+	rendering.store(false);
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -271,16 +593,18 @@ Java_com_philj56_gbcc_GLActivity_checkRom(
 		jstring file) {
 	char *filename = get_utf_string(env, file);
 
-	// We don't want the screen to try rendering anything
-	// while we're just checking the rom
-	pthread_mutex_lock(&render_mutex);
-	gbcc_initialise(&gbc.core, filename);
-
-	bool ret = gbc.core.initialised;
+	// Only validate the header here, so the ROM is read in just once,
+	// by loadRom, rather than fully initialised & freed first
+	struct rom_header header{};
+	bool ret = rom_header_read(filename, &header, rom_error, sizeof(rom_error));
 	if (ret) {
-		gbcc_free(&gbc.core);
+		rom_error[0] = '\0';
+		logger_print(LOGGER_INFO, "%s: %s, %u KiB ROM, %u KiB RAM",
+				header.title, header.mbc, header.rom_size / 1024, header.ram_size / 1024);
+		if (!header.checksum_valid) {
+			logger_print(LOGGER_WARNING, "%s: Invalid header checksum", header.title);
+		}
 	}
-	pthread_mutex_unlock(&render_mutex);
 	free(filename);
 	return static_cast<jboolean>(ret);
 }
@@ -288,14 +612,75 @@ Java_com_philj56_gbcc_GLActivity_checkRom(
 extern "C" JNIEXPORT jstring JNICALL
 Java_com_philj56_gbcc_GLActivity_getErrorMessage(
 		JNIEnv *env,
-		jobject/* this */) {
-	return env->NewStringUTF(gbc.core.error_msg);
+		jobject,/* this */
+		jlong handle) {
+	struct emulator *emu = from_handle(handle);
+	if (rom_error[0] != '\0' || emu == nullptr) {
+		return env->NewStringUTF(rom_error);
+	}
+	return env->NewStringUTF(emulator_error(emu));
+}
+
+extern "C" JNIEXPORT jobjectArray JNICALL
+Java_com_philj56_gbcc_main_RomLibrary_scan(
+		JNIEnv *env,
+		jclass,/* RomLibrary */
+		jobjectArray files,
+		jstring indexFile) {
+	jclass info_class = env->FindClass("com/philj56/gbcc/main/RomInfo");
+	jmethodID info_init = env->GetMethodID(info_class, "<init>", "(Ljava/lang/String;Ljava/lang/String;ZZZIII)V");
+
+	jsize count = env->GetArrayLength(files);
+	std::vector<char *> paths(count);
+	for (jsize i = 0; i < count; i++) {
+		auto file = static_cast<jstring>(env->GetObjectArrayElement(files, i));
+		paths[i] = get_utf_string(env, file);
+		env->DeleteLocalRef(file);
+	}
+	char *index_file = get_utf_string(env, indexFile);
+
+	std::vector<struct rom_library_entry> entries(count);
+	struct rom_library_stats stats = rom_library_scan(index_file, paths.data(), count, entries.data());
+	logger_print(LOGGER_INFO, "Scanned %d ROMs: %zu cached, %zu parsed, %zu missing",
+			count, stats.cached, stats.parsed, stats.missing);
+
+	jobjectArray ret = env->NewObjectArray(count, info_class, nullptr);
+	for (jsize i = 0; i < count; i++) {
+		free(paths[i]);
+		if (!entries[i].valid) {
+			continue;
+		}
+		const struct rom_header *h = &entries[i].header;
+		jstring title = env->NewStringUTF(h->title);
+		jstring mbc = env->NewStringUTF(h->mbc);
+		jobject info = env->NewObject(info_class, info_init, title, mbc,
+				static_cast<jboolean>(h->cgb),
+				static_cast<jboolean>(h->cgb_only),
+				static_cast<jboolean>(h->sgb),
+				static_cast<jint>(h->rom_size),
+				static_cast<jint>(h->ram_size),
+				static_cast<jint>(h->features));
+		env->SetObjectArrayElement(ret, i, info);
+		env->DeleteLocalRef(info);
+		env->DeleteLocalRef(mbc);
+		env->DeleteLocalRef(title);
+	}
+	free(index_file);
+	return ret;
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_philj56_gbcc_GLActivity_createEmulator(
+		JNIEnv *,
+		jobject /* this */) {
+	return reinterpret_cast<jlong>(emulator_create());
 }
 
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_philj56_gbcc_GLActivity_loadRom(
 		JNIEnv *env,
 		jobject,/* this */
+		jlong handle,
 		jstring file,
 		jint sampleRate,
 		jint samplesPerBuffer,
@@ -303,166 +688,229 @@ Java_com_philj56_gbcc_GLActivity_loadRom(
 		jstring configFile,
 		jstring cheatFile,
 		jobject prefs) {
+	struct emulator *emu = from_handle(handle);
+	struct gbcc *gbc = &emu->gbc;
+	char *fname = get_utf_string(env, file);
+	rom_error[0] = '\0';
 
-	fname = get_utf_string(env, file);
-
-	logfile_begin();
+	logger_begin("gbcc.log");
 
-	gbcc_initialise(&gbc.core, fname);
-	if (!gbc.core.initialised) {
+	// Without a device the core still runs, just silently
+	audio_output_begin(static_cast<unsigned int>(sampleRate), static_cast<unsigned int>(samplesPerBuffer));
+	if (!emulator_load(emu, fname, static_cast<unsigned int>(sampleRate),
+				static_cast<unsigned int>(samplesPerBuffer))) {
 		/* Something went wrong during initialisation */
 		free(fname);
-		free(saveDir);
-		logfile_end();
+		audio_output_end();
+		logger_end();
 		return static_cast<jboolean>(false);
 	}
 
-	gbc.quit = false;
-	gbc.has_focus = true;
-
 	{
 		char *save_dir = get_utf_string(env, saveDir);
-		strncpy(gbc.save_directory, save_dir, sizeof(gbc.save_directory));
+		strncpy(gbc->save_directory, save_dir, sizeof(gbc->save_directory));
 		free(save_dir);
 	}
 
-	gbcc_audio_initialise(&gbc, static_cast<size_t>(sampleRate), static_cast<size_t>(samplesPerBuffer));
-
-	__android_log_print(ANDROID_LOG_INFO, "GBCC", "%s", fname);
-	update_preferences(env, prefs);
+	logger_print(LOGGER_INFO, "%s", fname);
+	free(fname);
+	screenshot_begin("screenshots", rom_name(emu).c_str());
+	update_preferences(env, gbc, prefs);
 	if (configFile != nullptr) {
 		char *tmp = get_utf_string(env, configFile);
-		gbcc_load_config(&gbc, tmp);
+		gbcc_load_config(gbc, tmp);
 		free(tmp);
 	}
 	if (cheatFile != nullptr) {
-		gbc.core.cheats.num_genie_cheats = 0;
-		gbc.core.cheats.num_shark_cheats = 0;
+		gbc->core.cheats.num_genie_cheats = 0;
+		gbc->core.cheats.num_shark_cheats = 0;
 		char *tmp = get_utf_string(env, cheatFile);
-		gbcc_load_config(&gbc, tmp);
+		gbcc_load_config(gbc, tmp);
 		free(tmp);
 	}
 	if (options.initialised) {
-		gbc.turbo_speed = options.turbo_speed;
-		gbc.autosave = options.autosave;
-		gbc.frame_blending = options.frame_blending;
-		gbc.interlacing = options.interlacing;
-		gbc.show_fps = options.show_fps;
-		gbc.core.sync_to_video = options.sync_to_video;
-		gbc.core.ppu.palette = options.palette;
+		gbc->turbo_speed = options.turbo_speed;
+		gbc->autosave = options.autosave;
+		gbc->frame_blending = options.frame_blending;
+		gbc->interlacing = options.interlacing;
+		gbc->show_fps = options.show_fps;
+		gbc->core.sync_to_video = options.sync_to_video;
+		gbc->core.ppu.palette = options.palette;
 	}
 
-	pthread_create(&emu_thread, nullptr, gbcc_emulation_loop, &gbc);
+	frames_presented.store(0, std::memory_order_relaxed);
+	frames_repeated.store(0, std::memory_order_relaxed);
+	frames_skipped.store(0, std::memory_order_relaxed);
+	frame_metrics_reset();
+	last_present_us = 0;
+	last_emu_cpu_us = 0;
+	last_published = 0;
+	last_published_us = 0;
+	frame_hook_warned = false;
+	emu->turbo.store(gbc->core.keys.turbo);
+	emu->on_frame = between_frames;
+	emu->on_vsync_wait = record_vsync_wait;
+	if (!emulator_run(emu)) {
+		screenshot_end();
+		audio_output_end();
+		logger_end();
+		return static_cast<jboolean>(false);
+	}
+	pthread_getcpuclockid(emu->thread, &emu_clock);
+	displayed.store(emu);
 	return static_cast<jboolean>(true);
 }
+
+/* Stops and frees the emulator, whether or not it loaded */
 extern "C" JNIEXPORT void JNICALL
 Java_com_philj56_gbcc_GLActivity_quit(
 		JNIEnv *,
-		jobject /* this */) {
-
-	gbc.quit = true;
-	sem_post(&gbc.core.ppu.vsync_semaphore);
-	pthread_join(emu_thread, nullptr);
-
-	logfile_end();
+		jobject,/* this */
+		jlong handle) {
+	struct emulator *emu = from_handle(handle);
+	if (emu == nullptr) {
+		return;
+	}
+	if (!emu->running) {
+		emulator_destroy(emu);
+		return;
+	}
+	emulator_stop(emu);
+	audio_output_end();
+	struct audio_output_stats audio = audio_output_get_stats();
+	logger_print(LOGGER_INFO, "Audio: %llu frames in, %llu out, %llu overrun, %llu underrun, ratio %.4f",
+			static_cast<unsigned long long>(audio.frames_written),
+			static_cast<unsigned long long>(audio.frames_read),
+			static_cast<unsigned long long>(audio.overrun_frames),
+			static_cast<unsigned long long>(audio.underrun_frames),
+			audio.ratio_ppm / 1e6);
+
+	if (emu->gbc.core.cart.mbc.type == CAMERA) {
+		logger_print(LOGGER_INFO,
+				"Camera frames: %llu published, %llu dropped, %llu reused",
+				static_cast<unsigned long long>(camera_buffer.published.load()),
+				static_cast<unsigned long long>(camera_buffer.dropped.load()),
+				static_cast<unsigned long long>(camera_buffer.reused.load()));
+	}
 
 	// Don't allow the screen to be drawn to while we're freeing the core
-	struct timespec wait_time;  // NOLINT
-	clock_gettime(CLOCK_REALTIME, &wait_time);
-	wait_time.tv_sec += 1;
-	if (pthread_mutex_timedlock(&render_mutex, &wait_time) == 0) {
-		gbcc_free(&gbc.core);
-		pthread_mutex_unlock(&render_mutex);
-	} else {
-		// If we failed to acquire the lock, just free anyway and hope for the best
-		gbcc_free(&gbc.core);
+	struct emulator *expected = emu;
+	displayed.compare_exchange_strong(expected, nullptr);
+	pthread_mutex_lock(&camera_lock);
+	camera_downscale_destroy(&camera_ds);
+	pthread_mutex_unlock(&camera_lock);
+	struct timespec now;  // NOLINT
+	struct timespec deadline;  // NOLINT
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += 1;
+	bool idle = true;
+	while (rendering.load()) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > deadline.tv_sec
+				|| (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec)) {
+			idle = false;
+			break;
+		}
+		sched_yield();
 	}
-	gbcc_audio_destroy(&gbc);
-	free(fname);
-	fname = nullptr;
+	logger_print(LOGGER_INFO, "Frames: %llu published, %llu presented, %llu dropped, %llu repeated, %llu renders with none displayed",
+			static_cast<unsigned long long>(emu->exchange.published.load()),
+			static_cast<unsigned long long>(frames_presented.load()),
+			static_cast<unsigned long long>(emu->exchange.dropped.load()),
+			static_cast<unsigned long long>(frames_repeated.load()),
+			static_cast<unsigned long long>(frames_skipped.load()));
+	if (emu->input.dropped.load() > 0) {
+		logger_print(LOGGER_WARNING, "Input events dropped: %llu",
+				static_cast<unsigned long long>(emu->input.dropped.load()));
+	}
+	if (!idle) {
+		// The renderer may still be using the emulator, recorder & screenshot writer
+		logger_print(LOGGER_ERROR, "Renderer stuck, leaking the emulator");
+		frame_metrics_log();
+		logger_end();
+		options = (struct gbcc_temp_options){0}; //NOLINT
+		return;
+	}
+	end_recording();
+	screenshot_end();
+	struct screenshot_stats screenshots = screenshot_get_stats();
+	if (screenshots.written + screenshots.dropped + screenshots.failed > 0) {
+		logger_print(LOGGER_INFO, "Screenshots: %llu written, %llu dropped, %llu failed",
+				static_cast<unsigned long long>(screenshots.written),
+				static_cast<unsigned long long>(screenshots.dropped),
+				static_cast<unsigned long long>(screenshots.failed));
+	}
+	frame_metrics_log();
+	logger_end();
+	if (emu->gbc.menu.initialised) {
+		gbcc_menu_destroy(&emu->gbc);
+	}
+	emulator_destroy(emu);
 	options = (struct gbcc_temp_options){0}; //NOLINT
 }
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_philj56_gbcc_GLActivity_toggleMenu(
 		JNIEnv *,
-		jobject /* this */) {
-	gbcc_input_process_key(&gbc, GBCC_KEY_MENU, true);
+		jobject,/* this */
+		jlong handle) {
+	struct emulator *emu = from_handle(handle);
+	if (emu == nullptr) {
+		return;
+	}
+	// Straight to the core, as the menu has to open even when it isn't emulating
+	gbcc_input_process_key(&emu->gbc, GBCC_KEY_MENU, true);
 }
 
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_philj56_gbcc_GLActivity_toggleTurbo(
 		JNIEnv *,
-		jobject /* this */) {
-	gbc.core.keys.turbo = !gbc.core.keys.turbo;
-	return gbc.core.keys.turbo;
+		jobject,/* this */
+		jlong handle) {
+	struct emulator *emu = from_handle(handle);
+	if (emu == nullptr) {
+		return static_cast<jboolean>(false);
+	}
+	bool turbo = !emu->turbo.load();
+	emu->gbc.core.keys.turbo = turbo;
+	emu->turbo.store(turbo);
+	return static_cast<jboolean>(turbo);
 }
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_philj56_gbcc_GLActivity_press(
 		JNIEnv *,
-		jobject /* this */,
+		jobject,/* this */
+		jlong handle,
 		jint key,
 		jboolean pressed) {
+	struct emulator *emu = from_handle(handle);
+	if (emu == nullptr) {
+		return;
+	}
+	uint64_t now = frame_metrics_now_us();
 	switch (key) {
-		case 0:
-			gbcc_input_process_key(&gbc, GBCC_KEY_A, pressed);
-			break;
-		case 1:
-			gbcc_input_process_key(&gbc, GBCC_KEY_B, pressed);
-			break;
-		case 2:
-			gbcc_input_process_key(&gbc, GBCC_KEY_START, pressed);
-			break;
-		case 3:
-			gbcc_input_process_key(&gbc, GBCC_KEY_SELECT, pressed);
-			break;
-		case 4:
-			gbcc_input_process_key(&gbc, GBCC_KEY_UP, pressed);
-			break;
-		case 5:
-			gbcc_input_process_key(&gbc, GBCC_KEY_DOWN, pressed);
-			break;
-		case 6:
-			gbcc_input_process_key(&gbc, GBCC_KEY_LEFT, pressed);
-			break;
-		case 7:
-			gbcc_input_process_key(&gbc, GBCC_KEY_RIGHT, pressed);
-			break;
-		case 8:
-			gbcc_input_process_key(&gbc, GBCC_KEY_TURBO, pressed);
-			break;
-		case 9:
-			gbcc_input_process_key(&gbc, GBCC_KEY_PAUSE, pressed);
-			break;
-		case 10:
-			gbcc_input_process_key(&gbc, GBCC_KEY_PRINTER, pressed);
-			break;
-		case 11:
-			gbcc_input_process_key(&gbc, GBCC_KEY_FPS, pressed);
-			break;
-		case 12:
-			gbcc_input_process_key(&gbc, GBCC_KEY_FRAME_BLENDING, pressed);
-			break;
-		case 13:
-			gbcc_input_process_key(&gbc, GBCC_KEY_VSYNC, pressed);
-			break;
-		case 14:
-			gbcc_input_process_key(&gbc, GBCC_KEY_LINK_CABLE, pressed);
-			break;
-		case 15:
-			gbcc_input_process_key(&gbc, GBCC_KEY_AUTOSAVE, pressed);
-			break;
-		case 16:
-			gbcc_input_process_key(&gbc, GBCC_KEY_MENU, pressed);
-			break;
-		case 17:
-			gbcc_input_process_key(&gbc, GBCC_KEY_INTERLACE, pressed);
+		case 19:
+			if (pressed) {
+				screenshot_requested.store(true);
+			}
 			break;
-		case 18:
-			gbcc_input_process_key(&gbc, GBCC_KEY_SHADER, pressed);
+		case 20:
+			if (pressed) {
+				recording_toggle_requested.store(true);
+			}
 			break;
 		default:
+			if (key >= 0 && key < NUM_JOYPAD_KEYS) {
+				// The joypad goes to the core between frames, see apply_input()
+				struct queued_key event = {now, key, static_cast<bool>(pressed)};
+				input_queue_push(&emu->input, &event);
+			} else if (key >= 0 && key < NUM_CORE_KEYS) {
+				// Everything else straight away, as pause, menu & the like must
+				// still work when the core isn't reaching frame boundaries
+				process_key(&emu->gbc, key, pressed);
+				emu->turbo.store(emu->gbc.core.keys.turbo);
+			}
 			break;
 	}
 }
@@ -470,25 +918,31 @@ Java_com_philj56_gbcc_GLActivity_press(
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_philj56_gbcc_GLActivity_isPressed(
 		JNIEnv *,
-		jobject /* this */,
+		jobject,/* this */
+		jlong handle,
 		jint key) {
+	struct emulator *emu = from_handle(handle);
+	if (emu == nullptr) {
+		return static_cast<jboolean>(false);
+	}
+	struct gbcc *gbc = &emu->gbc;
 	switch (key) {
 		case 0:
-			return static_cast<jboolean>(gbc.core.keys.a);
+			return static_cast<jboolean>(gbc->core.keys.a);
 		case 1:
-			return static_cast<jboolean>(gbc.core.keys.b);
+			return static_cast<jboolean>(gbc->core.keys.b);
 		case 2:
-			return static_cast<jboolean>(gbc.core.keys.start);
+			return static_cast<jboolean>(gbc->core.keys.start);
 		case 3:
-			return static_cast<jboolean>(gbc.core.keys.select);
+			return static_cast<jboolean>(gbc->core.keys.select);
 		case 4:
-			return static_cast<jboolean>(gbc.core.keys.dpad.up);
+			return static_cast<jboolean>(gbc->core.keys.dpad.up);
 		case 5:
-			return static_cast<jboolean>(gbc.core.keys.dpad.down);
+			return static_cast<jboolean>(gbc->core.keys.dpad.down);
 		case 6:
-			return static_cast<jboolean>(gbc.core.keys.dpad.left);
+			return static_cast<jboolean>(gbc->core.keys.dpad.left);
 		case 7:
-			return static_cast<jboolean>(gbc.core.keys.dpad.right);
+			return static_cast<jboolean>(gbc->core.keys.dpad.right);
 		default:
 			return static_cast<jboolean>(false);
 	}
@@ -497,48 +951,66 @@ Java_com_philj56_gbcc_GLActivity_isPressed(
 extern "C" JNIEXPORT void JNICALL
 Java_com_philj56_gbcc_GLActivity_saveState(
 		JNIEnv *,
-		jobject /* this */,
+		jobject,/* this */
+		jlong handle,
 		jint state) {
-	gbc.save_state = static_cast<int8_t>(state);
+	struct emulator *emu = from_handle(handle);
+	if (emu == nullptr) {
+		return;
+	}
+	struct gbcc *gbc = &emu->gbc;
+	gbc->save_state = static_cast<int8_t>(state);
 }
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_philj56_gbcc_GLActivity_loadState(
 		JNIEnv *,
-		jobject /* this */,
+		jobject,/* this */
+		jlong handle,
 		jint state) {
-	gbc.load_state = static_cast<int8_t>(state);
+	struct emulator *emu = from_handle(handle);
+	if (emu == nullptr) {
+		return;
+	}
+	struct gbcc *gbc = &emu->gbc;
+	gbc->load_state = static_cast<int8_t>(state);
 }
 
 extern "C" JNIEXPORT jbyteArray JNICALL
 Java_com_philj56_gbcc_GLActivity_getOptions(
 		JNIEnv *env,
-		jobject /* this */) {
+		jobject,/* this */
+		jlong handle) {
+	struct emulator *emu = from_handle(handle);
+	if (emu == nullptr) {
+		return nullptr;
+	}
+	struct gbcc *gbc = &emu->gbc;
 	options = {
 		.initialised = true,
 
-		.turbo_speed = gbc.turbo_speed,
-		.autosave = gbc.autosave,
-		.frame_blending = gbc.frame_blending,
-		.interlacing = gbc.interlacing,
-		.show_fps = gbc.show_fps,
+		.turbo_speed = gbc->turbo_speed,
+		.autosave = gbc->autosave,
+		.frame_blending = gbc->frame_blending,
+		.interlacing = gbc->interlacing,
+		.show_fps = gbc->show_fps,
 
-		.sync_to_video = gbc.core.sync_to_video,
+		.sync_to_video = gbc->core.sync_to_video,
 
-		.palette = gbc.core.ppu.palette,
+		.palette = gbc->core.ppu.palette,
 
-		.menu_initialised = gbc.menu.initialised,
-		.show = gbc.menu.show,
-		.save_state = gbc.menu.save_state,
-		.load_state = gbc.menu.load_state,
-		.selection = gbc.menu.selection,
+		.menu_initialised = gbc->menu.initialised,
+		.show = gbc->menu.show,
+		.save_state = gbc->menu.save_state,
+		.load_state = gbc->menu.load_state,
+		.selection = gbc->menu.selection,
 	};
 
 
-	if (gbc.window.initialised) {
-		const char *src = gbc.window.gl.shaders[gbc.window.gl.cur_shader].name;
+	if (gbc->window.initialised) {
+		const char *src = gbc->window.gl.shaders[gbc->window.gl.cur_shader].name;
 		if (src != nullptr) {
-			strncpy(options.shader, gbc.window.gl.shaders[gbc.window.gl.cur_shader].name, sizeof(options.shader));
+			strncpy(options.shader, gbc->window.gl.shaders[gbc->window.gl.cur_shader].name, sizeof(options.shader));
 		}
 	}
 
@@ -555,70 +1027,75 @@ Java_com_philj56_gbcc_GLActivity_setOptions(
 	env->GetByteArrayRegion(opts, 0, sizeof(options), reinterpret_cast<jbyte *>(&options));
 }
 
-extern "C" JNIEXPORT jboolean JNICALL
-Java_com_philj56_gbcc_GLActivity_checkVibrationFun(
-		JNIEnv *,
-		jobject /* this */) {
-	static bool last_rumble = false;
-	bool rumble = gbc.core.cart.rumble_state;
-	bool ret = (rumble != last_rumble);
-	last_rumble = rumble;
-	return static_cast<jboolean>(ret);
-}
-
-extern "C" JNIEXPORT jboolean JNICALL
-Java_com_philj56_gbcc_GLActivity_checkTurboFun(
-		JNIEnv *,
-		jobject /* this */) {
-	return static_cast<jboolean>(gbc.core.keys.turbo);
-}
-
-extern "C" JNIEXPORT jboolean JNICALL
-Java_com_philj56_gbcc_GLActivity_checkErrorFun(
-		JNIEnv *,
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_philj56_gbcc_GLActivity_getFrameMetrics(
+		JNIEnv *env,
 		jobject /* this */) {
-	return static_cast<jboolean>(gbc.core.error);
+	jlong summary[FRAME_METRIC_COUNT * FRAME_METRIC_NUM_FIELDS];
+	static_assert(sizeof(jlong) == sizeof(uint64_t), "jlong must be 64 bits");
+	frame_metrics_summarise(reinterpret_cast<uint64_t *>(summary));
+	jlongArray ret = env->NewLongArray(FRAME_METRIC_COUNT * FRAME_METRIC_NUM_FIELDS);
+	env->SetLongArrayRegion(ret, 0, FRAME_METRIC_COUNT * FRAME_METRIC_NUM_FIELDS, summary);
+	return ret;
 }
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_philj56_gbcc_GLActivity_flushLogs(
 		JNIEnv *,
 		jobject /* this */) {
-	if (logfile != nullptr) {
-		fflush(logfile);
-	}
+	logger_flush();
 }
 
 extern "C" JNIEXPORT void JNICALL
 Java_com_philj56_gbcc_GLActivity_updateAccelerometer(
 		JNIEnv *,
-		jobject /* this */,
+		jobject,/* this */
+		jlong handle,
 		jfloat x,
 		jfloat y) {
+	struct emulator *emu = from_handle(handle);
+	if (emu == nullptr) {
+		return;
+	}
+	struct gbcc *gbc = &emu->gbc;
 	const float g = 9.81;
-	gbc.core.cart.mbc.accelerometer.real_x = static_cast<uint16_t>(0x81D0u + (0x70 * x / g));
-	gbc.core.cart.mbc.accelerometer.real_y = static_cast<uint16_t>(0x81D0u - (0x70 * y / g));
+	gbc->core.cart.mbc.accelerometer.real_x = static_cast<uint16_t>(0x81D0u + (0x70 * x / g));
+	gbc->core.cart.mbc.accelerometer.real_y = static_cast<uint16_t>(0x81D0u - (0x70 * y / g));
 }
 
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_philj56_gbcc_GLActivity_hasRumble(
 		JNIEnv *,
-		jobject /* this */) {
-	return static_cast<jboolean>(gbc.core.cart.rumble);
+		jobject,/* this */
+		jlong handle) {
+	struct emulator *emu = from_handle(handle);
+	if (emu == nullptr) {
+		return static_cast<jboolean>(false);
+	}
+	struct gbcc *gbc = &emu->gbc;
+	return static_cast<jboolean>(gbc->core.cart.rumble);
 }
 
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_philj56_gbcc_GLActivity_hasAccelerometer(
 		JNIEnv *,
-		jobject /* this */) {
-	return static_cast<jboolean>(gbc.core.cart.mbc.type == MBC7);
+		jobject,/* this */
+		jlong handle) {
+	struct emulator *emu = from_handle(handle);
+	if (emu == nullptr) {
+		return static_cast<jboolean>(false);
+	}
+	struct gbcc *gbc = &emu->gbc;
+	return static_cast<jboolean>(gbc->core.cart.mbc.type == MBC7);
 }
 
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_philj56_gbcc_GLActivity_isCamera(
 		JNIEnv *,
-		jobject /* this */) {
-	return static_cast<jboolean>(gbc.core.cart.mbc.type == CAMERA);
+		jobject,/* this */
+		jlong handle) {
+	struct emulator *emu = from_handle(handle);
+	return static_cast<jboolean>(emu != nullptr && emu->gbc.core.cart.mbc.type == CAMERA);
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -630,85 +1107,24 @@ Java_com_philj56_gbcc_GLActivity_updateCamera(
 		jint height,
 		jint rotation,
 		jint rowStride) {
-	uint8_t *image = static_cast<uint8_t *>(env->GetDirectBufferAddress(buf));
-
-	// Perform box-blur downsampling of the sensor image to get out 128x128 gb camera image
-	int box_size = MIN(width, height) / 128 / 2 + 1;
-
-	// First we perform the horizontal blur
-	auto *new_row = static_cast<uint8_t *>(calloc(width, 1));
-	for (int j = 0; j < height; j++) {
-		uint8_t *row = &image[j * rowStride];
-		int sum = 0;
-		int div = 0;
-
-		for (int i = -box_size; i < width; i++) {
-			if (i < width - box_size) {
-				sum += row[i + box_size];
-			} else {
-				div--;
-			}
-			if (i >= box_size) {
-				sum -= row[i - box_size];
-			} else {
-				div++;
-			}
-
-			if (i >= 0) {
-				new_row[i] = static_cast<uint8_t>(sum / div);
-			}
-		}
-		memcpy(row, new_row, width);
-	}
-	free(new_row);
+	auto *image = static_cast<const uint8_t *>(env->GetDirectBufferAddress(buf));
 
-	// Then the vertical blur
-	auto *new_col = static_cast<uint8_t *>(calloc(height, 1));
-	for (int i = 0; i < width; i++) {
-		int sum = 0;
-		int div = 0;
-
-		for (int j = -box_size; j < height; j++) {
-			if (j < height - box_size) {
-				sum += image[(j + box_size) * rowStride + i];
-			} else {
-				div--;
-			}
-			if (j >= box_size) {
-				sum -= image[(j - box_size) * rowStride + i];
-			} else {
-				div++;
-			}
-
-			if (j >= 0) {
-				new_col[j] = static_cast<uint8_t>(sum / div);
-			}
-		}
-		for (int j = 0; j < height; j++) {
-			image[j * rowStride + i] = new_col[j];
-		}
+	// The camera outlives the emulator by a few frames after quit
+	pthread_mutex_lock(&camera_lock);
+	if (displayed.load() == nullptr) {
+		pthread_mutex_unlock(&camera_lock);
+		return;
 	}
-	free(new_col);
-
-	// Then we nearest-neighbour downscale and rotate
-	double scale = MIN(height, width) / 128.0;
-	for (int j = 0; j < 128; j++) {
-		for (int i = 0; i < 128; i++) {
-			int src_idx = (int)(j * scale) * rowStride + (int)(i * scale);
-			int dst_idx;
-			if (rotation == 90) {
-				dst_idx = i * 128 + (127 - j);
-			} else if (rotation == 180) {
-				dst_idx = (127 - j) * 128 + (127 - i);
-			} else if (rotation == 270) {
-				dst_idx = (127 - i) * 128 + j;
-			} else {
-				dst_idx = j * 128 + i;
-			}
 
-			camera_image[dst_idx] = image[src_idx];
-		}
+	// Box-blur downsample the sensor image to get our 128x128 gb camera image
+	if (camera_downscale_needs_configure(&camera_ds, width, height, rowStride, rotation)
+			&& !camera_downscale_configure(&camera_ds, width, height, rowStride, rotation)) {
+		pthread_mutex_unlock(&camera_lock);
+		return;
 	}
+	camera_downscale_run(&camera_ds, image, camera_image[triple_buffer_back(&camera_buffer)]);
+	triple_buffer_publish(&camera_buffer);
+	pthread_mutex_unlock(&camera_lock);
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -746,16 +1162,20 @@ Java_com_philj56_gbcc_GLActivity_setCameraImage(
 		JNIEnv *env,
 		jobject ,/* this */
 		jbyteArray data) {
+	// This is only called before the camera is started,
+	// so we're still the only producer for camera_buffer
+	uint8_t *dst = camera_image[triple_buffer_back(&camera_buffer)];
 	jbyte *image = env->GetByteArrayElements(data, nullptr);
 	// Have to use a for loop as the data is converted to int
 	// when loaded by Android, even though it's greyscale
 	for (int j = 0; j < GB_CAMERA_SENSOR_HEIGHT; j++) {
 		for (int i = 0; i < GB_CAMERA_SENSOR_WIDTH; i++) {
 			int idx = j * GB_CAMERA_SENSOR_WIDTH + i;
-			camera_image[idx] = static_cast<uint8_t>(image[4 * idx]);
+			dst[idx] = static_cast<uint8_t>(image[4 * idx]);
 		}
 	}
 	env->ReleaseByteArrayElements(data, image, JNI_ABORT);
+	triple_buffer_publish(&camera_buffer);
 }
 
 void gbcc_camera_platform_initialise(struct gbcc_camera_platform *camera) {
@@ -768,12 +1188,14 @@ void gbcc_camera_platform_destroy(struct gbcc_camera_platform *camera) {
 
 void gbcc_camera_platform_capture_image(struct gbcc_camera_platform *camera, uint8_t image[GB_CAMERA_SENSOR_SIZE]) {
 	(void) camera;
-	memcpy(image, camera_image, GB_CAMERA_SENSOR_SIZE);
+	// The core wants its own copy, so this is the only copy of each frame
+	memcpy(image, camera_image[triple_buffer_acquire(&camera_buffer)], GB_CAMERA_SENSOR_SIZE);
 }
 
 extern "C" void gbcc_screenshot(struct gbcc *gb) {
-	(void) gb;
-	// Stubbed
+	// The core calls this on the emulation thread, where its screen is stable.
+	// Just a copy; encoding & writing happen on the screenshot thread
+	screenshot_capture(gb->core.ppu.screen.sdl);
 }
 
 extern "C" void gbcc_fontmap_load(struct gbcc_fontmap *font) {
@@ -789,86 +1211,242 @@ extern "C" void gbcc_fontmap_destroy(struct gbcc_fontmap *font) {
 
 void gbcc_printer_platform_start_printing(struct printer *printer) {
 	(void) printer;
-	start_printing = true;
+	// Called from the emulation thread, which only the displayed emulator has a UI for
+	struct emulator *emu = emulator_current();
+	if (emu != displayed.load()) {
+		return;
+	}
+	update_emulator_state(emu);
+	publish_emulator_events(EMULATOR_EVENT_START_PRINTING);
 }
 
-extern "C" JNIEXPORT jboolean JNICALL
-Java_com_philj56_gbcc_GLActivity_printerConnected(
-        JNIEnv *,
-        jobject /* this */) {
-    return static_cast<jboolean>(gbc.core.link_cable.state == GBCC_LINK_CABLE_STATE_PRINTER);
+static int dispatch_emulator_events(int fd, int events, void *data) {
+	(void) events;
+	(void) data;
+	uint64_t count;
+	read(fd, &count, sizeof(count));
+
+	JNIEnv *env;
+	if (event_listener == nullptr
+			|| java_vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_6) != JNI_OK) {
+		return 1;
+	}
+	uint32_t status = emulator_pending.exchange(0) | emulator_state.load();
+	env->CallVoidMethod(event_listener, event_method, static_cast<jint>(status));
+	if (env->ExceptionCheck()) {
+		// Nothing up the stack would see it, and it'd break the next JNI call
+		logger_print(LOGGER_ERROR, "Exception in onEmulatorEvents");
+		env->ExceptionDescribe();
+		env->ExceptionClear();
+	}
+	return 1;
 }
 
-extern "C" JNIEXPORT jboolean JNICALL
-Java_com_philj56_gbcc_GLActivity_isPrinting(
-		JNIEnv *,
-		jobject /* this */) {
-	return static_cast<jboolean>(gbc.core.printer.status & 0x02u);
+void publish_emulator_events(uint32_t pending) {
+	// Only the first event since the last drain needs to wake the UI thread
+	if (emulator_pending.fetch_or(pending) == 0 && emulator_event_fd >= 0) {
+		uint64_t one = 1;
+		write(emulator_event_fd, &one, sizeof(one));
+	}
 }
 
-extern "C" JNIEXPORT jboolean JNICALL
-Java_com_philj56_gbcc_GLActivity_shouldStartPrinting(
-		JNIEnv *,
+/*
+ * Emulation thread between frames, or the renderer once those have stalled,
+ * when the emulation thread isn't stepping the core. Either way the state
+ * word is swapped atomically, so each change is published once.
+ */
+void update_emulator_state(struct emulator *emu) {
+	const struct gbcc *gbc = &emu->gbc;
+	uint32_t state = 0;
+	if (emu->turbo.load(std::memory_order_relaxed)) {
+		state |= EMULATOR_STATE_TURBO;
+	}
+	if (gbc->core.link_cable.state == GBCC_LINK_CABLE_STATE_PRINTER) {
+		state |= EMULATOR_STATE_PRINTER_CONNECTED;
+	}
+	if (gbc->core.printer.status & 0x02u) {
+		state |= EMULATOR_STATE_PRINTING;
+	}
+	if (gbc->core.cart.rumble_state) {
+		state |= EMULATOR_STATE_RUMBLE;
+	}
+	if (gbc->core.error) {
+		state |= EMULATOR_STATE_ERROR;
+	}
+	uint32_t old = emulator_state.exchange(state);
+	if (old != state) {
+		publish_emulator_events((old ^ state) << EMULATOR_CHANGED_SHIFT);
+	}
+}
+
+/*
+ * Deliver emulator events to GLActivity.onEmulatorEvents() on the calling
+ * thread's looper. Must be called from the UI thread.
+ */
+extern "C" JNIEXPORT void JNICALL
+Java_com_philj56_gbcc_GLActivity_registerEmulatorEvents(
+		JNIEnv *env,
+		jobject thiz,
+		jlong handle) {
+	if (emulator_event_fd < 0) {
+		emulator_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		env->GetJavaVM(&java_vm);
+	}
+	if (event_listener != nullptr) {
+		env->DeleteGlobalRef(event_listener);
+	}
+	event_listener = env->NewGlobalRef(thiz);
+	jclass cls = env->GetObjectClass(thiz);
+	event_method = env->GetMethodID(cls, "onEmulatorEvents", "(I)V");
+	env->DeleteLocalRef(cls);
+
+	ALooper_addFd(ALooper_forThread(), emulator_event_fd, ALOOPER_POLL_CALLBACK,
+			ALOOPER_EVENT_INPUT, dispatch_emulator_events, nullptr);
+
+	// Make sure the UI starts off in sync; the emulation thread keeps the state current
+	(void) handle;
+	publish_emulator_events(EMULATOR_EVENT_REFRESH);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_philj56_gbcc_GLActivity_unregisterEmulatorEvents(
+		JNIEnv *env,
 		jobject /* this */) {
-	bool ret = start_printing;
-    if (start_printing) {
-        start_printing = false;
-    }
-	return static_cast<jboolean>(ret);
+	if (emulator_event_fd >= 0) {
+		ALooper_removeFd(ALooper_forThread(), emulator_event_fd);
+	}
+	if (event_listener != nullptr) {
+		env->DeleteGlobalRef(event_listener);
+		event_listener = nullptr;
+	}
+	emulator_pending.store(0);
 }
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_philj56_gbcc_GLActivity_resetPrinter(
 		JNIEnv *env,
-		jobject /* this */) {
-	gbcc_printer_initialise(&gbc.core.printer);
-	print_stage = 0;
-	start_printing = false;
+		jobject,/* this */
+		jlong handle) {
+	struct emulator *emu = from_handle(handle);
+	if (emu == nullptr) {
+		return;
+	}
+	struct gbcc *gbc = &emu->gbc;
+	gbcc_printer_initialise(&gbc->core.printer);
+	emu->print_stage = 0;
+	emulator_pending.fetch_and(~EMULATOR_EVENT_START_PRINTING);
 }
 
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_philj56_gbcc_GLActivity_updatePrinter(
 		JNIEnv *env,
-		jobject /* this */) {
+		jobject,/* this */
+		jlong handle) {
+	struct emulator *emu = from_handle(handle);
+	if (emu == nullptr) {
+		return static_cast<jboolean>(false);
+	}
+	struct gbcc *gbc = &emu->gbc;
 	bool finished = false;
-	struct printer *p = &gbc.core.printer;
-	if (print_stage == 0) {
-		print_stage += print_margin(p, true);
+	struct printer *p = &gbc->core.printer;
+	int *stage = &emu->print_stage;
+	if (*stage == 0) {
+		*stage += print_margin(p, true);
 	}
-	if (print_stage == 1) {
-		print_stage += print_strip(p);
+	if (*stage == 1) {
+		*stage += print_strip(p);
 		if (p->print_byte == p->image_buffer.length && p->margin.bottom_width == 0) {
 			finished = true;
 		}
 	}
-	if (print_stage == 2) {
-		print_stage += print_margin(p, false);
+	if (*stage == 2) {
+		*stage += print_margin(p, false);
 		if (p->margin.bottom_line >= p->margin.bottom_width) {
 			finished = true;
 		}
 	}
-	if (print_stage >= 3) {
+	if (*stage >= 3) {
 		finished = true;
 	}
 	if (finished) {
-		print_stage = 0;
+		*stage = 0;
 		gbcc_printer_initialise(p);
 	}
 	return static_cast<jboolean>(finished);
 }
 
-extern "C" JNIEXPORT jbyteArray JNICALL
-Java_com_philj56_gbcc_GLActivity_getPrinterStrip(
-        JNIEnv *env,
-        jobject /* this */) {
-    jbyteArray arr;
-    if (print_strip_done) {
-        print_strip_done = false;
-        arr = env->NewByteArray(PRINTER_STRIP_BYTES);
-        env->SetByteArrayRegion(arr, 0, PRINTER_STRIP_BYTES, (jbyte *) print_buffer);
-    } else {
-        arr = env->NewByteArray(0);
-    }
-    return arr;
+extern "C" JNIEXPORT jobject JNICALL
+Java_com_philj56_gbcc_GLActivity_getPrinterImage(
+		JNIEnv *env,
+		jobject /* this */) {
+	if (printer_image_length == 0) {
+		return nullptr;
+	}
+	return env->NewDirectByteBuffer(printer_image, static_cast<jlong>(printer_image_length));
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_philj56_gbcc_GLActivity_setPrinterImage(
+		JNIEnv *env,
+		jobject /* this */,
+		jbyteArray data) {
+	printer_image_length = 0;
+	size_t length = static_cast<size_t>(env->GetArrayLength(data));
+	uint8_t *dst = printer_image_extend(length);
+	if (dst != nullptr) {
+		env->GetByteArrayRegion(data, 0, static_cast<jsize>(length), reinterpret_cast<jbyte *>(dst));
+	}
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_philj56_gbcc_GLActivity_clearPrinterImage(
+		JNIEnv *,
+		jobject /* this */) {
+	if (printer_image != nullptr) {
+		// Hand the pages back, anything still looking at them just sees blank paper
+		madvise(printer_image, PRINTER_IMAGE_MAX_BYTES, MADV_DONTNEED);
+	}
+	printer_image_length = 0;
+}
+
+uint8_t *printer_image_extend(size_t bytes) {
+	if (printer_image == nullptr) {
+		void *addr = mmap(nullptr, PRINTER_IMAGE_MAX_BYTES, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (addr == MAP_FAILED) {
+			logger_print(LOGGER_ERROR, "Failed to map printer image");
+			return nullptr;
+		}
+		printer_image = static_cast<uint8_t *>(addr);
+	}
+	if (printer_image_length + bytes > PRINTER_IMAGE_MAX_BYTES) {
+		logger_print(LOGGER_WARNING, "Printer image full, dropping output");
+		return nullptr;
+	}
+	uint8_t *tail = &printer_image[printer_image_length];
+	printer_image_length += bytes;
+	return tail;
+}
+
+void update_printer_lut(struct printer *p) {
+	static const uint8_t shades[4] = {0, 85, 170, 255};
+	uint8_t colours[4];
+	for (uint8_t c = 0; c < 4; c++) {
+		colours[c] = shades[gbcc_printer_get_palette_colour(p, c) & 0x03u];
+	}
+	if (printer_lut_valid && memcmp(colours, printer_lut_colours, sizeof(colours)) == 0) {
+		return;
+	}
+	for (unsigned int idx = 0; idx < 256; idx++) {
+		unsigned int hi = idx >> 4u;
+		unsigned int lo = idx & 0x0Fu;
+		for (unsigned int x = 0; x < 4; x++) {
+			unsigned int bit = 3 - x;
+			printer_lut[idx][x] = colours[(((hi >> bit) & 1u) << 1u) | ((lo >> bit) & 1u)];
+		}
+	}
+	memcpy(printer_lut_colours, colours, sizeof(colours));
+	printer_lut_valid = true;
 }
 
 bool print_margin(struct printer *p, bool top) {
@@ -877,20 +1455,15 @@ bool print_margin(struct printer *p, bool top) {
 	} else if (!top && p->margin.bottom_line >= p->margin.bottom_width) {
 		return true;
 	}
-	for (int line = 0; line < PRINTER_STRIP_HEIGHT; line++) {
-		for (uint8_t tx = 0; tx < PRINTER_WIDTH_TILES; tx++) {
-			for (uint8_t x = 0; x < 8; x++) {
-				size_t idx = line * 8 * PRINTER_WIDTH_TILES + x + 8 * tx;
-				print_buffer[idx] = 0;
-			}
-		}
+	uint8_t *strip = printer_image_extend(PRINTER_STRIP_BYTES);
+	if (strip != nullptr) {
+		memset(strip, 0, PRINTER_STRIP_BYTES);
 	}
 	if (top) {
 		p->margin.top_line++;
 	} else {
 		p->margin.bottom_line++;
 	}
-    print_strip_done = true;
 	return false;
 }
 
@@ -899,34 +1472,28 @@ bool print_strip(struct printer *p)
 	if (p->print_byte == p->image_buffer.length) {
 		return true;
 	}
+	uint8_t *strip = printer_image_extend(PRINTER_STRIP_BYTES);
+	if (strip == nullptr) {
+		// Nowhere to put it, so just consume the data
+		p->print_byte = p->image_buffer.length;
+		return true;
+	}
+	update_printer_lut(p);
 	unsigned int line;
 	for (line = 0; (line < PRINTER_STRIP_HEIGHT) && (p->print_byte < p->image_buffer.length); line++) {
 		uint8_t ty = (uint8_t)((line + p->print_line) / 8);
+		uint8_t *row = &strip[line * PRINTER_LINE_BYTES];
 		for (uint8_t tx = 0; tx < PRINTER_WIDTH_TILES; tx++) {
 			uint16_t idx = ty * PRINTER_WIDTH_TILES * 16 + tx * 16 + (uint8_t)(line + p->print_line - ty * 8) * 2;
 			uint8_t lo = p->image_buffer.data[idx];
 			uint8_t hi = p->image_buffer.data[idx + 1];
-			for (uint8_t x = 0; x < 8; x++) {
-				size_t didx = line * 8 * PRINTER_WIDTH_TILES + x + 8 * tx;
-				switch (gbcc_printer_get_palette_colour(p, (uint8_t)(check_bit(hi, 7 - x) << 1u) | check_bit(lo, 7 - x))) {
-					case 0:
-						print_buffer[didx] = 0;
-						break;
-					case 1:
-						print_buffer[didx] = 85;
-						break;
-					case 2:
-						print_buffer[didx] = 170;
-						break;
-					case 3:
-						print_buffer[didx] = 255;
-						break;
-				}
-			}
+			memcpy(&row[8 * tx], printer_lut[(hi & 0xF0u) | (lo >> 4u)], 4);
+			memcpy(&row[8 * tx + 4], printer_lut[((hi & 0x0Fu) << 4u) | (lo & 0x0Fu)], 4);
 			p->print_byte += 2;
 		}
 	}
+	// Blank out the rest of a short final strip
+	memset(&strip[line * PRINTER_LINE_BYTES], 0, (PRINTER_STRIP_HEIGHT - line) * PRINTER_LINE_BYTES);
 	p->print_line += line;
-    print_strip_done = true;
 	return 0;
 }
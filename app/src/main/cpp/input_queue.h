@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_INPUT_QUEUE_H
+#define GBCC_ANDROID_INPUT_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Lock-free single-producer, single-consumer queue of timestamped key
+ * events, so the thread handling input never touches the core's key state
+ * itself. The consumer applies events at a point of its choosing, in order.
+ */
+#define INPUT_QUEUE_SIZE 256u
+
+static_assert((INPUT_QUEUE_SIZE & (INPUT_QUEUE_SIZE - 1)) == 0, "INPUT_QUEUE_SIZE must be a power of two");
+
+struct queued_key {
+	uint64_t time_us;  /* From frame_metrics_now_us() */
+	int32_t key;
+	bool pressed;
+};
+
+struct input_queue {
+	struct queued_key events[INPUT_QUEUE_SIZE];
+	std::atomic<uint32_t> head{0};
+	std::atomic<uint32_t> tail{0};
+
+	/* Statistics, readable from any thread */
+	std::atomic<uint64_t> dropped{0};  /* Pushed while full */
+};
+
+/* Producer: returns false, dropping the event, if the queue is full */
+static inline bool input_queue_push(struct input_queue *q, const struct queued_key *event) {
+	uint32_t head = q->head.load(std::memory_order_relaxed);
+	if (head - q->tail.load(std::memory_order_acquire) == INPUT_QUEUE_SIZE) {
+		q->dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	q->events[head & (INPUT_QUEUE_SIZE - 1)] = *event;
+	q->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+/* Consumer: the oldest event, which stays valid until popped, or nullptr */
+static inline const struct queued_key *input_queue_peek(struct input_queue *q) {
+	uint32_t tail = q->tail.load(std::memory_order_relaxed);
+	if (tail == q->head.load(std::memory_order_acquire)) {
+		return nullptr;
+	}
+	return &q->events[tail & (INPUT_QUEUE_SIZE - 1)];
+}
+
+static inline void input_queue_pop(struct input_queue *q) {
+	q->tail.fetch_add(1, std::memory_order_release);
+}
+
+#endif /* GBCC_ANDROID_INPUT_QUEUE_H */
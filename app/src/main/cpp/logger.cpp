@@ -0,0 +1,459 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#include "logger.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <android/log.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define RING_MAGIC 0x474C4F47u /* "GLOG" */
+#define RING_VERSION 1u
+#define RING_RECORDS 1024u
+#define RECORD_MESSAGE_LEN 232u
+#define LOG_MAX_BYTES (1024u * 1024u)
+#define BATCH_BYTES (64u * 1024u)
+#define PIPE_BYTES (1024 * 1024)
+
+/*
+ * A bounded multi-producer ring, where each record's sequence number says
+ * whether it's free for position n (n) or holds the record for it (n + 1).
+ */
+struct log_record {
+	std::atomic<uint64_t> sequence;
+	int64_t time_ms;
+	int32_t tid;
+	uint8_t level;
+	uint16_t length;
+	char message[RECORD_MESSAGE_LEN];
+};
+
+struct log_ring {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t capacity;
+	uint32_t clean;  /* Set once everything's been written out */
+	std::atomic<uint64_t> head;
+	std::atomic<uint64_t> tail;
+	std::atomic<uint64_t> dropped;
+	struct log_record records[RING_RECORDS];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "The log ring must be lock-free");
+
+/* The ring & wake fd stay around once created, so producers never race a teardown */
+static struct log_ring *ring;
+static int wake_fd = -1;
+static std::atomic<bool> active;
+
+static std::string log_path;
+static int log_fd = -1;
+static size_t log_size;
+static int pipe_fd = -1;
+static int saved_stdout = -1;
+static int saved_stderr = -1;
+static pthread_t writer;
+static std::atomic<bool> stopping;
+
+/* logger_flush requests, and the latest one a completed writer pass started after */
+static std::mutex flush_mutex;
+static std::condition_variable flush_cond;
+static uint64_t flush_requested;
+static uint64_t flush_completed;
+
+static uint64_t stdio_overflows;  /* Writer only */
+
+static char batch[BATCH_BYTES];
+static size_t batch_len;
+
+static int android_priority(uint8_t level) {
+	switch (level) {
+		case LOGGER_DEBUG:
+			return ANDROID_LOG_DEBUG;
+		case LOGGER_WARNING:
+			return ANDROID_LOG_WARN;
+		case LOGGER_ERROR:
+			return ANDROID_LOG_ERROR;
+		default:
+			return ANDROID_LOG_INFO;
+	}
+}
+
+static void write_all(int fd, const char *buf, size_t len) {
+	while (len > 0) {
+		ssize_t ret = write(fd, buf, len);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+		buf += ret;
+		len -= static_cast<size_t>(ret);
+	}
+}
+
+static void open_log(bool truncate) {
+	log_fd = open(log_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : O_APPEND), 0644);
+	off_t size = log_fd >= 0 ? lseek(log_fd, 0, SEEK_END) : 0;
+	log_size = size > 0 ? static_cast<size_t>(size) : 0;
+}
+
+/* Keep the current log as the single backup, and start a new one */
+static void rotate_log() {
+	if (log_fd >= 0) {
+		close(log_fd);
+	}
+	rename(log_path.c_str(), (log_path + ".1").c_str());
+	open_log(true);
+}
+
+static void flush_batch() {
+	if (batch_len == 0 || log_fd < 0) {
+		batch_len = 0;
+		return;
+	}
+	write_all(log_fd, batch, batch_len);
+	log_size += batch_len;
+	batch_len = 0;
+	if (log_size >= LOG_MAX_BYTES) {
+		rotate_log();
+	}
+}
+
+static void emit(const char *buf, size_t len) {
+	while (len > 0) {
+		size_t n = std::min(len, BATCH_BYTES - batch_len);
+		memcpy(&batch[batch_len], buf, n);
+		batch_len += n;
+		buf += n;
+		len -= n;
+		if (batch_len == BATCH_BYTES) {
+			flush_batch();
+		}
+	}
+}
+
+static void emit_record(const struct log_record *rec, const char *prefix) {
+	static const char levels[] = "DIWE";
+	time_t secs = static_cast<time_t>(rec->time_ms / 1000);
+	struct tm tm{};
+	localtime_r(&secs, &tm);
+	char line[64 + RECORD_MESSAGE_LEN];
+	int len = snprintf(line, sizeof(line), "%s%02d:%02d:%02d.%03d %c/%d: %.*s\n",
+			prefix,
+			tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<int>(rec->time_ms % 1000),
+			levels[std::min<uint8_t>(rec->level, LOGGER_ERROR)],
+			rec->tid,
+			static_cast<int>(std::min<uint16_t>(rec->length, RECORD_MESSAGE_LEN - 1)),
+			rec->message);
+	emit(line, std::min(static_cast<size_t>(std::max(len, 0)), sizeof(line) - 1));
+}
+
+/* Returns false once the write end has been closed */
+static bool drain_pipe() {
+	char buf[4096];
+	while (true) {
+		ssize_t ret = read(pipe_fd, buf, sizeof(buf));
+		if (ret > 0) {
+			emit(buf, static_cast<size_t>(ret));
+		} else if (ret < 0 && errno == EINTR) {
+			continue;
+		} else {
+			return ret < 0;
+		}
+	}
+}
+
+static void drain_ring() {
+	uint64_t pos = ring->tail.load(std::memory_order_relaxed);
+	while (true) {
+		struct log_record *rec = &ring->records[pos % RING_RECORDS];
+		if (rec->sequence.load(std::memory_order_acquire) != pos + 1) {
+			break;
+		}
+		emit_record(rec, "");
+		__android_log_write(android_priority(rec->level), "GBCC", rec->message);
+		rec->sequence.store(pos + RING_RECORDS, std::memory_order_release);
+		pos++;
+	}
+	ring->tail.store(pos, std::memory_order_release);
+
+	uint64_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+	if (dropped > 0) {
+		char line[64];
+		int len = snprintf(line, sizeof(line), "(%llu log records dropped)\n",
+				static_cast<unsigned long long>(dropped));
+		emit(line, static_cast<size_t>(len));
+	}
+}
+
+/*
+ * stdio marks a stream when a write to the full pipe fails, and keeps what
+ * it can buffer for the next attempt. Raw writes to the fd's are lost
+ * outright, and can't be seen from here.
+ */
+static void check_stdio() {
+	uint64_t failed = 0;
+	for (FILE *fp : {stdout, stderr}) {
+		if (ferror(fp)) {
+			clearerr(fp);
+			failed++;
+		}
+	}
+	if (failed > 0) {
+		stdio_overflows += failed;
+		char line[96];
+		int len = snprintf(line, sizeof(line), "(stdout/stderr overflowed the log pipe, %llu times so far)\n",
+				static_cast<unsigned long long>(stdio_overflows));
+		emit(line, static_cast<size_t>(len));
+	}
+}
+
+static void *writer_thread(void *) {
+	struct pollfd fds[2] = {
+		{pipe_fd, POLLIN, 0},
+		{wake_fd, POLLIN, 0}
+	};
+	while (true) {
+		if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+			break;
+		}
+		if (fds[1].revents & POLLIN) {
+			uint64_t val;
+			read(wake_fd, &val, sizeof(val));
+		}
+		bool stop = stopping.load();
+		uint64_t flush;
+		{
+			std::lock_guard<std::mutex> lock(flush_mutex);
+			flush = flush_requested;
+		}
+		if (fds[0].fd >= 0 && !drain_pipe()) {
+			fds[0].fd = -1;
+		}
+		check_stdio();
+		drain_ring();
+		flush_batch();
+		{
+			std::lock_guard<std::mutex> lock(flush_mutex);
+			flush_completed = flush;
+		}
+		flush_cond.notify_all();
+		if (stop) {
+			break;
+		}
+	}
+	return nullptr;
+}
+
+static void wake_writer() {
+	uint64_t one = 1;
+	write(wake_fd, &one, sizeof(one));
+}
+
+static void init_ring() {
+	ring->magic = RING_MAGIC;
+	ring->version = RING_VERSION;
+	ring->capacity = RING_RECORDS;
+	ring->head.store(0);
+	ring->tail.store(0);
+	ring->dropped.store(0);
+	for (uint32_t i = 0; i < RING_RECORDS; i++) {
+		ring->records[i].sequence.store(i);
+	}
+}
+
+/* Write out anything a previous process logged but never got to write */
+static void recover_ring() {
+	if (ring->magic != RING_MAGIC
+			|| ring->version != RING_VERSION
+			|| ring->capacity != RING_RECORDS
+			|| ring->clean) {
+		return;
+	}
+	uint64_t head = ring->head.load();
+	uint64_t pos = ring->tail.load();
+	if (head - pos > RING_RECORDS) {
+		return;
+	}
+	for (; pos != head; pos++) {
+		struct log_record *rec = &ring->records[pos % RING_RECORDS];
+		if (rec->sequence.load() == pos + 1) {
+			emit_record(rec, "(recovered) ");
+		}
+	}
+	flush_batch();
+}
+
+static bool map_ring() {
+	std::string ring_path = log_path + ".ring";
+	int fd = open(ring_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	bool ok = ftruncate(fd, sizeof(struct log_ring)) == 0;
+	if (ok) {
+		void *map = mmap(nullptr, sizeof(struct log_ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		ok = map != MAP_FAILED;
+		if (ok) {
+			ring = static_cast<struct log_ring *>(map);
+		}
+	}
+	close(fd);
+	return ok;
+}
+
+void logger_begin(const char *filename) {
+	log_path = filename;
+	if (wake_fd < 0) {
+		wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	}
+	if (ring == nullptr && map_ring()) {
+		// Recover into the previous session's log, before it's rotated out
+		open_log(false);
+		recover_ring();
+		close(log_fd);
+		log_fd = -1;
+	}
+	rotate_log();
+	if (ring == nullptr || wake_fd < 0) {
+		return;
+	}
+	init_ring();
+	ring->clean = 0;
+	stdio_overflows = 0;
+
+	// Redirect stdout & stderr into a pipe, storing old fd's for later restoration
+	int fds[2];
+	if (pipe2(fds, O_CLOEXEC) == 0) {
+		// Neither end may block; a writer facing a full pipe loses output instead
+		fcntl(fds[0], F_SETFL, O_NONBLOCK);
+		fcntl(fds[1], F_SETFL, O_NONBLOCK);
+		fcntl(fds[1], F_SETPIPE_SZ, PIPE_BYTES);
+		fflush(stdout);
+		fflush(stderr);
+		saved_stdout = dup(STDOUT_FILENO);
+		saved_stderr = dup(STDERR_FILENO);
+		dup2(fds[1], STDOUT_FILENO);
+		dup2(fds[1], STDERR_FILENO);
+		close(fds[1]);
+		pipe_fd = fds[0];
+	}
+
+	stopping.store(false);
+	active.store(true);
+	pthread_create(&writer, nullptr, writer_thread, nullptr);
+}
+
+void logger_end() {
+	if (!active.load()) {
+		if (log_fd >= 0) {
+			close(log_fd);
+			log_fd = -1;
+		}
+		return;
+	}
+
+	// Restore stdout & stderr
+	fflush(stdout);
+	fflush(stderr);
+	if (pipe_fd >= 0) {
+		dup2(saved_stdout, STDOUT_FILENO);
+		dup2(saved_stderr, STDERR_FILENO);
+		close(saved_stdout);
+		close(saved_stderr);
+	}
+
+	active.store(false);
+	stopping.store(true);
+	wake_writer();
+	pthread_join(writer, nullptr);
+	ring->clean = 1;
+
+	if (pipe_fd >= 0) {
+		close(pipe_fd);
+		pipe_fd = -1;
+	}
+	close(log_fd);
+	log_fd = -1;
+}
+
+void logger_print(enum logger_level level, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	if (!active.load(std::memory_order_acquire)) {
+		__android_log_vprint(android_priority(level), "GBCC", fmt, args);
+		va_end(args);
+		return;
+	}
+
+	uint64_t pos = ring->head.load(std::memory_order_relaxed);
+	struct log_record *rec;
+	while (true) {
+		rec = &ring->records[pos % RING_RECORDS];
+		uint64_t seq = rec->sequence.load(std::memory_order_acquire);
+		auto diff = static_cast<int64_t>(seq - pos);
+		if (diff == 0) {
+			if (ring->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			// Full, and we'd rather lose a message than wait
+			ring->dropped.fetch_add(1, std::memory_order_relaxed);
+			va_end(args);
+			return;
+		} else {
+			pos = ring->head.load(std::memory_order_relaxed);
+		}
+	}
+
+	struct timespec ts{};
+	clock_gettime(CLOCK_REALTIME, &ts);
+	rec->time_ms = static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+	rec->tid = static_cast<int32_t>(syscall(SYS_gettid));
+	rec->level = static_cast<uint8_t>(level);
+	int len = vsnprintf(rec->message, sizeof(rec->message), fmt, args);
+	rec->length = static_cast<uint16_t>(std::min(std::max(len, 0), static_cast<int>(RECORD_MESSAGE_LEN) - 1));
+	va_end(args);
+
+	rec->sequence.store(pos + 1, std::memory_order_release);
+	wake_writer();
+}
+
+void logger_flush() {
+	if (!active.load()) {
+		return;
+	}
+	fflush(stdout);
+	fflush(stderr);
+
+	// Wait for a whole writer pass that started after this point
+	std::unique_lock<std::mutex> lock(flush_mutex);
+	uint64_t target = ++flush_requested;
+	wake_writer();
+	flush_cond.wait_for(lock, std::chrono::seconds(1), [target] { return flush_completed >= target; });
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_LOGGER_H
+#define GBCC_ANDROID_LOGGER_H
+
+/*
+ * Asynchronous logger.
+ *
+ * Between logger_begin and logger_end, stdout & stderr are redirected into a
+ * pipe, and logger_print calls are copied into a lock-free ring of fixed-size
+ * records. A background thread drains both into the log file (and logcat),
+ * so no thread ever waits on file I/O to log something.
+ *
+ * The ring is a shared mapping of a file next to the log, so if the process
+ * dies, any records not yet written are recovered by the next logger_begin.
+ */
+
+enum logger_level {
+	LOGGER_DEBUG,
+	LOGGER_INFO,
+	LOGGER_WARNING,
+	LOGGER_ERROR
+};
+
+void logger_begin(const char *filename);
+void logger_end();
+
+/* Safe from any thread, never blocks; falls back to logcat if not started */
+void logger_print(enum logger_level level, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+
+/* Block until everything logged so far has been written out */
+void logger_flush();
+
+#endif /* GBCC_ANDROID_LOGGER_H */
@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+# Copyright (C) 2019-2020 Philip Jones
+#
+# Licensed under the MIT License.
+# See either the LICENSE file, or:
+#
+# https://opensource.org/licenses/MIT
+#
+#
+# Builds an instrumented gbcc-bench, replays each training workload in
+# pgo/workloads, and merges the result into pgo/default.profdata, the
+# profile GBCC_PGO=USE picks up by default. Then builds the plain and
+# profile-guided benchmarks and reports the speedup on the same workloads.
+#
+# The Android release build only uses it when asked to, with
+#   ./gradlew assembleRelease -Pgbcc.pgoProfile=src/main/cpp/pgo/default.profdata
+#
+# Usage: pgo/train.sh [build-dir]
+#
+# Needs clang and a matching llvm-profdata; override with CC, CXX and
+# LLVM_PROFDATA.
+
+set -eu
+
+here=$(cd "$(dirname "$0")" && pwd)
+src=$(dirname "$here")
+mkdir -p "${1:-build-pgo}"
+out=$(cd "${1:-build-pgo}" && pwd)
+profile=${GBCC_PROFILE:-"$here/default.profdata"}
+CC=${CC:-clang}
+CXX=${CXX:-clang++}
+LLVM_PROFDATA=${LLVM_PROFDATA:-llvm-profdata}
+
+build() {
+	dir="$out/$1"
+	shift
+	cmake -S "$src" -B "$dir" \
+		-DCMAKE_BUILD_TYPE=Release \
+		-DCMAKE_C_COMPILER="$CC" \
+		-DCMAKE_CXX_COMPILER="$CXX" \
+		-DGBCC_PROFILE="$profile" \
+		"$@" > /dev/null
+	cmake --build "$dir" --target gbcc-bench > /dev/null
+}
+
+# Run every workload with the given benchmark, printing "<label> <fps>"
+run_workloads() {
+	bench=$1
+	grep -v '^[[:space:]]*\(#\|$\)' "$here/workloads" | while read -r rom inputs frames; do
+		label="$(basename "$rom")"
+		set -- -n "$frames"
+		if [ "$inputs" != "-" ]; then
+			label="$label+$(basename "$inputs")"
+			set -- "$@" -i "$src/$inputs"
+		fi
+		fps=$("$bench" "$@" "$src/$rom" | awk '/^Emulated FPS:/ { print $3 }')
+		echo "$label $fps"
+	done
+}
+
+echo "Building instrumented benchmark"
+build instrumented -DGBCC_PGO=GENERATE
+rm -rf "$out/profiles"
+mkdir -p "$out/profiles"
+
+echo "Training"
+LLVM_PROFILE_FILE="$out/profiles/%p.profraw" \
+	run_workloads "$out/instrumented/gbcc-bench" > /dev/null
+"$LLVM_PROFDATA" merge -o "$profile" "$out/profiles"/*.profraw
+echo "Wrote $profile"
+
+echo "Building plain & profile-guided benchmarks"
+build plain -DGBCC_PGO=OFF
+# The profile is fresh, so any mismatch is a real problem
+build optimised -DGBCC_PGO=USE \
+	-DCMAKE_C_FLAGS=-Werror=profile-instr-out-of-date \
+	-DCMAKE_CXX_FLAGS=-Werror=profile-instr-out-of-date
+
+run_workloads "$out/plain/gbcc-bench" > "$out/plain.txt"
+run_workloads "$out/optimised/gbcc-bench" > "$out/optimised.txt"
+
+echo
+printf "%-40s %10s %10s %8s\n" "Workload" "Plain FPS" "PGO FPS" "Speedup"
+paste -d ' ' "$out/plain.txt" "$out/optimised.txt" | while read -r label plain _ optimised; do
+	printf "%-40s %10s %10s %7.2fx\n" "$label" "$plain" "$optimised" \
+		"$(echo "$optimised $plain" | awk '{ print $1 / $2 }')"
+done
@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#include "recorder.h"
+#include "audio_sink.h"
+#include "audio_stream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/stat.h>
+
+extern "C" {
+#include <core.h>
+}
+
+#define FRAME_PIXELS (GBCC_SCREEN_WIDTH * GBCC_SCREEN_HEIGHT)
+#define VIDEO_BUFFER_BYTES (1024 * 1024)
+#define SILENCE_FRAMES 1024
+#define AUDIO_GAPS 64u
+/* The frame rate, exactly */
+#define GB_CLOCK_HZ 4194304
+#define GB_FRAME_CLOCKS 70224
+
+static_assert((RECORDER_AUDIO_FRAMES & (RECORDER_AUDIO_FRAMES - 1)) == 0,
+		"The audio ring must be a power of two");
+static_assert((AUDIO_GAPS & (AUDIO_GAPS - 1)) == 0, "The gap ring must be a power of two");
+
+/* Audio dropped while the ring was full, to be replaced by silence in place */
+struct audio_gap {
+	uint64_t position;  /* In frames accepted before the gap */
+	uint64_t length;
+};
+
+struct frame_slot {
+	uint64_t index;
+	uint32_t pixels[FRAME_PIXELS];
+};
+
+static struct frame_slot *slots;
+static std::atomic<size_t> frame_head;
+static std::atomic<size_t> frame_tail;
+static uint64_t frame_count;  /* Producer only, including drops */
+static uint64_t final_count;
+
+static int16_t *audio_ring;
+static std::atomic<size_t> audio_head;
+static std::atomic<size_t> audio_tail;
+static struct audio_gap gaps[AUDIO_GAPS];
+static std::atomic<size_t> gap_head;
+static std::atomic<size_t> gap_tail;
+static struct audio_gap pending_gap;  /* Producer only, until the next accepted frame */
+
+static FILE *video;
+static struct audio_sink audio;
+static bool has_audio;
+
+static sem_t ready;
+static pthread_t encoder;
+static std::atomic<bool> active;
+static std::atomic<bool> stopping;
+/* Set while the audio producer is in recorder_push_audio(), see recorder_end() */
+static std::atomic<bool> audio_busy;
+
+static std::atomic<uint64_t> frames_written;
+static std::atomic<uint64_t> frames_dropped;
+static std::atomic<uint64_t> audio_written;
+static std::atomic<uint64_t> audio_dropped;
+
+/* BT.601 limited range, which is what Y4M readers assume */
+static void rgb_to_yuv(const uint32_t *frame, uint8_t *planes) {
+	uint8_t *y = planes;
+	uint8_t *u = &planes[FRAME_PIXELS];
+	uint8_t *v = &planes[2 * FRAME_PIXELS];
+	for (size_t i = 0; i < FRAME_PIXELS; i++) {
+		// PPU pixels are 0xRRGGBBAA
+		int r = static_cast<int>((frame[i] >> 24u) & 0xFFu);
+		int g = static_cast<int>((frame[i] >> 16u) & 0xFFu);
+		int b = static_cast<int>((frame[i] >> 8u) & 0xFFu);
+		y[i] = static_cast<uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+		u[i] = static_cast<uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+		v[i] = static_cast<uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+	}
+}
+
+static void write_frame(const uint8_t *planes) {
+	fputs("FRAME\n", video);
+	fwrite(planes, 1, 3 * FRAME_PIXELS, video);
+	frames_written.fetch_add(1, std::memory_order_relaxed);
+}
+
+static void write_silence(uint64_t length) {
+	static const int16_t silence[SILENCE_FRAMES * AUDIO_CHANNELS] = {0};
+	while (length > 0) {
+		auto count = static_cast<size_t>(std::min<uint64_t>(length, SILENCE_FRAMES));
+		audio_sink_write(&audio, silence, count);
+		audio_written.fetch_add(count, std::memory_order_relaxed);
+		length -= count;
+	}
+}
+
+static void drain_audio() {
+	if (!has_audio) {
+		return;
+	}
+	// Gaps are published before the frames after them, so load them second
+	size_t head = audio_head.load(std::memory_order_acquire);
+	size_t gap_end = gap_head.load(std::memory_order_acquire);
+	size_t gap = gap_tail.load(std::memory_order_relaxed);
+	size_t tail = audio_tail.load(std::memory_order_relaxed);
+	while (true) {
+		// Stand in for dropped audio where it was dropped, to keep the two streams in sync
+		for (; gap != gap_end && gaps[gap & (AUDIO_GAPS - 1)].position == tail; gap++) {
+			write_silence(gaps[gap & (AUDIO_GAPS - 1)].length);
+		}
+		size_t end = head;
+		if (gap != gap_end) {
+			end = std::min<size_t>(end, gaps[gap & (AUDIO_GAPS - 1)].position);
+		}
+		if (tail == end) {
+			break;
+		}
+		size_t offset = tail & (RECORDER_AUDIO_FRAMES - 1);
+		size_t count = std::min(end - tail, RECORDER_AUDIO_FRAMES - offset);
+		audio_sink_write(&audio, &audio_ring[offset * AUDIO_CHANNELS], count);
+		audio_written.fetch_add(count, std::memory_order_relaxed);
+		tail += count;
+	}
+	audio_tail.store(tail, std::memory_order_release);
+	gap_tail.store(gap, std::memory_order_release);
+}
+
+/* Producer: publish the gap before anything after it, returning false if there's no room */
+static bool flush_gap() {
+	if (pending_gap.length == 0) {
+		return true;
+	}
+	size_t head = gap_head.load(std::memory_order_relaxed);
+	if (head - gap_tail.load(std::memory_order_acquire) == AUDIO_GAPS) {
+		return false;
+	}
+	gaps[head & (AUDIO_GAPS - 1)] = pending_gap;
+	gap_head.store(head + 1, std::memory_order_release);
+	pending_gap.length = 0;
+	return true;
+}
+
+static void *encoder_thread(void *arg) {
+	(void) arg;
+	std::vector<uint8_t> last(3 * FRAME_PIXELS);
+	std::vector<uint8_t> current(3 * FRAME_PIXELS);
+	bool have_last = false;
+	uint64_t next_index = 0;
+
+	while (true) {
+		if (sem_wait(&ready) != 0) {
+			continue;
+		}
+		bool stop = stopping.load();
+		size_t head = frame_head.load(std::memory_order_acquire);
+		for (size_t tail = frame_tail.load(std::memory_order_relaxed); tail != head; tail++) {
+			struct frame_slot *slot = &slots[tail % RECORDER_FRAME_SLOTS];
+			uint64_t index = slot->index;
+			rgb_to_yuv(slot->pixels, current.data());
+			frame_tail.store(tail + 1, std::memory_order_release);
+
+			// Hold the last frame over any that were dropped, or this one if there's none yet
+			for (; next_index < index; next_index++) {
+				write_frame(have_last ? last.data() : current.data());
+			}
+			write_frame(current.data());
+			next_index = index + 1;
+			std::swap(last, current);
+			have_last = true;
+		}
+		drain_audio();
+		if (stop) {
+			// Frames dropped at the very end have nothing after them to trigger a repeat
+			for (; have_last && next_index < final_count; next_index++) {
+				write_frame(last.data());
+			}
+			drain_audio();
+			break;
+		}
+	}
+	return nullptr;
+}
+
+static std::string recording_path(const char *directory, const char *name, const char *extension) {
+	time_t now = time(nullptr);
+	struct tm tm{};
+	localtime_r(&now, &tm);
+	char stamp[32];
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+	return std::string(directory) + "/" + name + "-" + stamp + extension;
+}
+
+bool recorder_begin(const char *directory, const char *name, unsigned int sample_rate) {
+	if (active.load()) {
+		return true;
+	}
+	if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+		return false;
+	}
+	slots = static_cast<struct frame_slot *>(malloc(RECORDER_FRAME_SLOTS * sizeof(*slots)));
+	audio_ring = static_cast<int16_t *>(malloc(RECORDER_AUDIO_FRAMES * AUDIO_CHANNELS * sizeof(*audio_ring)));
+	video = fopen(recording_path(directory, name, ".y4m").c_str(), "wb");
+	has_audio = sample_rate > 0;
+	if (slots == nullptr || audio_ring == nullptr || video == nullptr
+			|| (has_audio && !audio_sink_wav(&audio, recording_path(directory, name, ".wav").c_str(), sample_rate))) {
+		if (video != nullptr) {
+			fclose(video);
+			video = nullptr;
+		}
+		free(slots);
+		free(audio_ring);
+		return false;
+	}
+	setvbuf(video, nullptr, _IOFBF, VIDEO_BUFFER_BYTES);
+	fprintf(video, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C444\n",
+			GBCC_SCREEN_WIDTH, GBCC_SCREEN_HEIGHT, GB_CLOCK_HZ, GB_FRAME_CLOCKS);
+
+	frame_head.store(0);
+	frame_tail.store(0);
+	frame_count = 0;
+	audio_head.store(0);
+	audio_tail.store(0);
+	gap_head.store(0);
+	gap_tail.store(0);
+	pending_gap = {};
+	frames_written.store(0);
+	frames_dropped.store(0);
+	audio_written.store(0);
+	audio_dropped.store(0);
+
+	sem_init(&ready, 0, 0);
+	stopping.store(false);
+	if (pthread_create(&encoder, nullptr, encoder_thread, nullptr) != 0) {
+		sem_destroy(&ready);
+		fclose(video);
+		video = nullptr;
+		if (has_audio) {
+			audio_sink_close(&audio);
+		}
+		free(slots);
+		free(audio_ring);
+		return false;
+	}
+	active.store(true);
+	return true;
+}
+
+void recorder_end() {
+	if (!active.load()) {
+		return;
+	}
+	active.store(false);
+	// Both flags are sequentially consistent, so the audio producer either
+	// sees we've stopped, or we see it busy and wait the length of a copy
+	while (audio_busy.load()) {
+		sched_yield();
+	}
+	final_count = frame_count;
+	bool gap_flushed = flush_gap();
+	stopping.store(true);
+	sem_post(&ready);
+	pthread_join(encoder, nullptr);
+	if (!gap_flushed) {
+		// The encoder has emptied the gap ring, so there's room for the last one now
+		flush_gap();
+		drain_audio();
+	}
+	sem_destroy(&ready);
+
+	fclose(video);
+	video = nullptr;
+	if (has_audio) {
+		audio_sink_close(&audio);
+	}
+	free(slots);
+	slots = nullptr;
+	free(audio_ring);
+	audio_ring = nullptr;
+}
+
+bool recorder_active() {
+	return active.load(std::memory_order_relaxed);
+}
+
+uint32_t *recorder_frame_acquire() {
+	if (!active.load(std::memory_order_relaxed)) {
+		return nullptr;
+	}
+	size_t head = frame_head.load(std::memory_order_relaxed);
+	if (head - frame_tail.load(std::memory_order_acquire) == RECORDER_FRAME_SLOTS) {
+		frame_count++;
+		frames_dropped.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	struct frame_slot *slot = &slots[head % RECORDER_FRAME_SLOTS];
+	slot->index = frame_count++;
+	return slot->pixels;
+}
+
+void recorder_frame_commit() {
+	frame_head.fetch_add(1, std::memory_order_release);
+	sem_post(&ready);
+}
+
+bool recorder_push_frame(const uint32_t *frame) {
+	uint32_t *dst = recorder_frame_acquire();
+	if (dst == nullptr) {
+		return false;
+	}
+	memcpy(dst, frame, FRAME_PIXELS * sizeof(*frame));
+	recorder_frame_commit();
+	return true;
+}
+
+void recorder_skip_frames(uint64_t count) {
+	if (!active.load(std::memory_order_relaxed)) {
+		return;
+	}
+	frame_count += count;
+	frames_dropped.fetch_add(count, std::memory_order_relaxed);
+}
+
+size_t recorder_push_audio(const int16_t *frames, size_t count) {
+	audio_busy.store(true);
+	if (!active.load() || !has_audio) {
+		audio_busy.store(false, std::memory_order_release);
+		return 0;
+	}
+	size_t head = audio_head.load(std::memory_order_relaxed);
+	size_t space = RECORDER_AUDIO_FRAMES - (head - audio_tail.load(std::memory_order_acquire));
+	size_t accepted = std::min(count, space);
+	if (accepted > 0 && !flush_gap()) {
+		// Nowhere to mark the gap, so it has to grow instead
+		accepted = 0;
+	}
+	for (size_t done = 0; done < accepted;) {
+		size_t offset = (head + done) & (RECORDER_AUDIO_FRAMES - 1);
+		size_t n = std::min(accepted - done, RECORDER_AUDIO_FRAMES - offset);
+		memcpy(&audio_ring[offset * AUDIO_CHANNELS], &frames[done * AUDIO_CHANNELS],
+				n * AUDIO_CHANNELS * sizeof(*frames));
+		done += n;
+	}
+	audio_head.store(head + accepted, std::memory_order_release);
+	if (accepted < count) {
+		if (pending_gap.length == 0) {
+			pending_gap.position = head + accepted;
+		}
+		pending_gap.length += count - accepted;
+		audio_dropped.fetch_add(count - accepted, std::memory_order_relaxed);
+	}
+	audio_busy.store(false, std::memory_order_release);
+	return accepted;
+}
+
+struct recorder_stats recorder_get_stats() {
+	struct recorder_stats stats{};
+	stats.frames_written = frames_written.load();
+	stats.frames_dropped = frames_dropped.load();
+	stats.audio_written = audio_written.load();
+	stats.audio_dropped = audio_dropped.load();
+	return stats;
+}
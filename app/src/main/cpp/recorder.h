@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_RECORDER_H
+#define GBCC_ANDROID_RECORDER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define RECORDER_FRAME_SLOTS 32
+#define RECORDER_AUDIO_FRAMES 32768
+
+/*
+ * Streaming gameplay recorder.
+ *
+ * Frames go into a bounded ring of frame-sized slots, and stereo samples
+ * into a ring of their own, both single-producer, single-consumer. An
+ * encoder thread drains them into directory/name-<time>.y4m (4:4:4, at the
+ * Game Boy's exact frame rate) and, if a sample rate is given, a matching
+ * .wav.
+ *
+ * Frames and samples may come from different producer threads, such as the
+ * renderer and the emulation thread, but each from only one.
+ *
+ * The producers never wait. When the encoder falls behind and the rings are
+ * full, frames & samples are dropped and counted, and the encoder fills the
+ * gaps by repeating the last frame or writing silence where the samples
+ * were dropped, so the two files stay the right length and in sync.
+ */
+
+struct recorder_stats {
+	uint64_t frames_written;    /* Including repeats */
+	uint64_t frames_dropped;
+	uint64_t audio_written;     /* Stereo frames, including silence */
+	uint64_t audio_dropped;
+};
+
+/* sample_rate may be 0 to record video only */
+bool recorder_begin(const char *directory, const char *name, unsigned int sample_rate);
+
+/*
+ * Write out everything queued, then close the files. Call from the frame
+ * producer's thread, or once it has stopped. The audio producer may still
+ * be running, and anything it pushes afterwards is ignored.
+ */
+void recorder_end();
+
+bool recorder_active();
+
+/*
+ * Frame producer: a slot to write the next GBCC_SCREEN_WIDTH x GBCC_SCREEN_HEIGHT
+ * frame into, or nullptr if the ring is full, in which case the frame is
+ * counted as dropped. Each successful acquire must be followed by a commit.
+ */
+uint32_t *recorder_frame_acquire();
+void recorder_frame_commit();
+
+/* Frame producer: acquire, copy & commit, returning false if the frame was dropped */
+bool recorder_push_frame(const uint32_t *frame);
+
+/*
+ * Frame producer: count frames that were never pushed, such as ones the renderer
+ * never saw, so the encoder repeats the last frame over them too
+ */
+void recorder_skip_frames(uint64_t count);
+
+/* Audio producer: interleaved stereo frames, returning the number accepted */
+size_t recorder_push_audio(const int16_t *frames, size_t count);
+
+struct recorder_stats recorder_get_stats();
+
+#endif /* GBCC_ANDROID_RECORDER_H */
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#include "rom_header.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define HEADER_END 0x150u
+#define TITLE_START 0x134u
+#define CGB_FLAG 0x143u
+#define SGB_FLAG 0x146u
+#define CARTRIDGE_TYPE 0x147u
+#define ROM_SIZE 0x148u
+#define RAM_SIZE 0x149u
+#define HEADER_CHECKSUM 0x14Du
+
+#define RAM ROM_FEATURE_RAM
+#define BATTERY ROM_FEATURE_BATTERY
+#define TIMER ROM_FEATURE_TIMER
+#define RUMBLE ROM_FEATURE_RUMBLE
+
+static const struct {
+	uint8_t type;
+	const char *mbc;
+	uint32_t features;
+} cartridge_types[] = {
+	{0x00, "ROM", 0},
+	{0x01, "MBC1", 0},
+	{0x02, "MBC1", RAM},
+	{0x03, "MBC1", RAM | BATTERY},
+	{0x05, "MBC2", RAM},
+	{0x06, "MBC2", RAM | BATTERY},
+	{0x08, "ROM", RAM},
+	{0x09, "ROM", RAM | BATTERY},
+	{0x0B, "MMM01", 0},
+	{0x0C, "MMM01", RAM},
+	{0x0D, "MMM01", RAM | BATTERY},
+	{0x0F, "MBC3", TIMER | BATTERY},
+	{0x10, "MBC3", TIMER | RAM | BATTERY},
+	{0x11, "MBC3", 0},
+	{0x12, "MBC3", RAM},
+	{0x13, "MBC3", RAM | BATTERY},
+	{0x19, "MBC5", 0},
+	{0x1A, "MBC5", RAM},
+	{0x1B, "MBC5", RAM | BATTERY},
+	{0x1C, "MBC5", RUMBLE},
+	{0x1D, "MBC5", RUMBLE | RAM},
+	{0x1E, "MBC5", RUMBLE | RAM | BATTERY},
+	{0x20, "MBC6", RAM | BATTERY},
+	{0x22, "MBC7", ROM_FEATURE_ACCELEROMETER | RUMBLE | RAM | BATTERY},
+	{0xFC, "CAMERA", ROM_FEATURE_CAMERA | RAM | BATTERY},
+	{0xFD, "TAMA5", RAM | BATTERY},
+	{0xFE, "HuC3", TIMER | RAM | BATTERY},
+	{0xFF, "HuC1", RAM | BATTERY},
+};
+
+static const uint32_t ram_sizes[] = {
+	0,
+	2 * 1024,
+	8 * 1024,
+	32 * 1024,
+	128 * 1024,
+	64 * 1024
+};
+
+bool rom_header_cartridge(uint8_t type, const char **mbc, uint32_t *features) {
+	for (const auto &t : cartridge_types) {
+		if (t.type == type) {
+			*mbc = t.mbc;
+			*features = t.features;
+			return true;
+		}
+	}
+	*mbc = "Unknown";
+	*features = 0;
+	return false;
+}
+
+bool rom_header_parse(const uint8_t *data, size_t size, struct rom_header *header, char *error, size_t error_len) {
+	*header = {};
+	if (size < HEADER_END) {
+		snprintf(error, error_len, "File too small to be a ROM (%zu bytes)", size);
+		return false;
+	}
+
+	uint8_t checksum = 0;
+	for (size_t i = TITLE_START; i < HEADER_CHECKSUM; i++) {
+		checksum = static_cast<uint8_t>(checksum - data[i] - 1);
+	}
+	header->checksum_valid = (checksum == data[HEADER_CHECKSUM]);
+
+	header->cartridge_type = data[CARTRIDGE_TYPE];
+	rom_header_cartridge(header->cartridge_type, &header->mbc, &header->features);
+
+	uint8_t rom_size = data[ROM_SIZE];
+	if (rom_size <= 0x08) {
+		header->rom_size = UINT32_C(0x8000) << rom_size;
+	} else if (rom_size >= 0x52 && rom_size <= 0x54) {
+		static const uint32_t banks[] = {72, 80, 96};
+		header->rom_size = banks[rom_size - 0x52] * 0x4000;
+	} else {
+		snprintf(error, error_len, "Unknown ROM size 0x%02X", rom_size);
+		return false;
+	}
+
+	uint8_t ram_size = data[RAM_SIZE];
+	if (ram_size < sizeof(ram_sizes) / sizeof(ram_sizes[0])) {
+		header->ram_size = ram_sizes[ram_size];
+	}
+
+	/* CGB titles are only 11 or 15 characters, the rest is the manufacturer code & flag */
+	uint8_t cgb_flag = data[CGB_FLAG];
+	header->cgb = (cgb_flag & 0x80u) != 0;
+	header->cgb_only = (cgb_flag == 0xC0u);
+	header->sgb = (data[SGB_FLAG] == 0x03u);
+	size_t title_len = header->cgb ? 15 : ROM_HEADER_TITLE_LEN;
+	size_t len = 0;
+	for (; len < title_len; len++) {
+		char c = static_cast<char>(data[TITLE_START + len]);
+		if (c == '\0') {
+			break;
+		}
+		header->title[len] = (c >= ' ' && c <= '~') ? c : '?';
+	}
+	header->title[len] = '\0';
+
+	return true;
+}
+
+bool rom_header_read(const char *filename, struct rom_header *header, char *error, size_t error_len) {
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		snprintf(error, error_len, "Failed to open %s: %s", filename, strerror(errno));
+		return false;
+	}
+	uint8_t data[HEADER_END];
+	ssize_t size;
+	do {
+		size = pread(fd, data, sizeof(data), 0);
+	} while (size < 0 && errno == EINTR);
+	int err = errno;
+	close(fd);
+	if (size < 0) {
+		snprintf(error, error_len, "Failed to read %s: %s", filename, strerror(err));
+		return false;
+	}
+	// A short read of a regular file only happens at its end
+	return rom_header_parse(data, static_cast<size_t>(size), header, error, error_len);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_ROM_HEADER_H
+#define GBCC_ANDROID_ROM_HEADER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define ROM_HEADER_TITLE_LEN 16
+#define ROM_HEADER_ERROR_LEN 128
+
+/* Cartridge features, as decoded from the cartridge type byte */
+#define ROM_FEATURE_RAM (1u << 0u)
+#define ROM_FEATURE_BATTERY (1u << 1u)
+#define ROM_FEATURE_TIMER (1u << 2u)
+#define ROM_FEATURE_RUMBLE (1u << 3u)
+#define ROM_FEATURE_ACCELEROMETER (1u << 4u)
+#define ROM_FEATURE_CAMERA (1u << 5u)
+
+struct rom_header {
+	char title[ROM_HEADER_TITLE_LEN + 1];
+	bool cgb;          /* Has CGB enhancements */
+	bool cgb_only;
+	bool sgb;
+	bool checksum_valid; /* Real hardware won't boot it otherwise, but emulators will */
+	uint8_t cartridge_type;
+	const char *mbc;   /* Static string, e.g. "MBC5", or "Unknown" */
+	uint32_t features; /* ROM_FEATURE_* */
+	uint32_t rom_size; /* Bytes, as declared by the header */
+	uint32_t ram_size; /* Bytes, as declared by the header */
+};
+
+/*
+ * Look up the MBC name & features of a cartridge type byte, returning false
+ * (with "Unknown" and no features) if it isn't one we know of
+ */
+bool rom_header_cartridge(uint8_t type, const char **mbc, uint32_t *features);
+
+/*
+ * Parse and validate a cartridge header from memory. Only the first 0x150
+ * bytes are looked at. On failure, a description is written to error.
+ *
+ * A bad header checksum or unknown cartridge type isn't a failure; whether
+ * the ROM can actually be run is up to the core.
+ */
+bool rom_header_parse(const uint8_t *data, size_t size, struct rom_header *header, char *error, size_t error_len);
+
+/* Validate a ROM file's header, reading in just the header itself */
+bool rom_header_read(const char *filename, struct rom_header *header, char *error, size_t error_len);
+
+#endif /* GBCC_ANDROID_ROM_HEADER_H */
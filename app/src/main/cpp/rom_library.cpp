@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#include "rom_library.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define INDEX_MAGIC "GBCCROMI"
+#define INDEX_VERSION 2u
+#define INDEX_MAX_PATH 4096u
+
+#define FLAG_CGB (1u << 0u)
+#define FLAG_CGB_ONLY (1u << 1u)
+#define FLAG_SGB (1u << 2u)
+#define FLAG_BAD_CHECKSUM (1u << 3u)
+
+/*
+ * On-disk record, followed by path_len bytes of path. The index is private
+ * to the device, so it's just native endianness & layout, with the version
+ * bumped whenever this changes.
+ */
+struct index_record {
+	int64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	uint32_t path_len;
+	uint32_t rom_size;
+	uint32_t ram_size;
+	uint8_t valid;
+	uint8_t flags;
+	uint8_t cartridge_type;
+	char title[ROM_HEADER_TITLE_LEN + 1];
+};
+
+struct index_entry {
+	int64_t size;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	struct rom_library_entry entry;
+};
+
+using rom_index = std::unordered_map<std::string, struct index_entry>;
+
+/* Scans from different threads would otherwise race on the index file */
+static std::mutex scan_mutex;
+
+static void load_index(const char *filename, rom_index &index) {
+	FILE *fp = fopen(filename, "rbe");
+	if (fp == nullptr) {
+		return;
+	}
+	char magic[sizeof(INDEX_MAGIC) - 1];
+	uint32_t version;
+	if (fread(magic, sizeof(magic), 1, fp) != 1
+			|| memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0
+			|| fread(&version, sizeof(version), 1, fp) != 1
+			|| version != INDEX_VERSION) {
+		fclose(fp);
+		return;
+	}
+
+	struct index_record rec{};
+	std::string path;
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		if (rec.path_len == 0 || rec.path_len > INDEX_MAX_PATH) {
+			break;
+		}
+		path.resize(rec.path_len);
+		if (fread(&path[0], rec.path_len, 1, fp) != 1) {
+			break;
+		}
+		struct index_entry e{};
+		e.size = rec.size;
+		e.mtime_sec = rec.mtime_sec;
+		e.mtime_nsec = rec.mtime_nsec;
+		e.entry.valid = rec.valid != 0;
+		if (e.entry.valid) {
+			struct rom_header *h = &e.entry.header;
+			rom_header_cartridge(rec.cartridge_type, &h->mbc, &h->features);
+			memcpy(h->title, rec.title, sizeof(h->title));
+			h->title[ROM_HEADER_TITLE_LEN] = '\0';
+			h->cgb = rec.flags & FLAG_CGB;
+			h->cgb_only = rec.flags & FLAG_CGB_ONLY;
+			h->sgb = rec.flags & FLAG_SGB;
+			h->checksum_valid = !(rec.flags & FLAG_BAD_CHECKSUM);
+			h->cartridge_type = rec.cartridge_type;
+			h->rom_size = rec.rom_size;
+			h->ram_size = rec.ram_size;
+		}
+		index[path] = e;
+	}
+	fclose(fp);
+}
+
+/* Write to a temporary file first, so a crash can't leave a torn index */
+static void save_index(const char *filename, const rom_index &index) {
+	std::string tmp = std::string(filename) + ".tmp";
+	FILE *fp = fopen(tmp.c_str(), "wbe");
+	if (fp == nullptr) {
+		return;
+	}
+	uint32_t version = INDEX_VERSION;
+	bool ok = fwrite(INDEX_MAGIC, sizeof(INDEX_MAGIC) - 1, 1, fp) == 1
+		&& fwrite(&version, sizeof(version), 1, fp) == 1;
+	for (const auto &it : index) {
+		if (!ok) {
+			break;
+		}
+		const struct index_entry &e = it.second;
+		const struct rom_header &h = e.entry.header;
+		struct index_record rec{};
+		rec.size = e.size;
+		rec.mtime_sec = e.mtime_sec;
+		rec.mtime_nsec = e.mtime_nsec;
+		rec.path_len = static_cast<uint32_t>(it.first.size());
+		rec.valid = e.entry.valid;
+		if (e.entry.valid) {
+			rec.flags = (h.cgb ? FLAG_CGB : 0u) | (h.cgb_only ? FLAG_CGB_ONLY : 0u) | (h.sgb ? FLAG_SGB : 0u)
+				| (h.checksum_valid ? 0u : FLAG_BAD_CHECKSUM);
+			rec.cartridge_type = h.cartridge_type;
+			rec.rom_size = h.rom_size;
+			rec.ram_size = h.ram_size;
+			memcpy(rec.title, h.title, sizeof(rec.title));
+		}
+		ok = fwrite(&rec, sizeof(rec), 1, fp) == 1
+			&& fwrite(it.first.data(), it.first.size(), 1, fp) == 1;
+	}
+	if (fclose(fp) != 0 || !ok || rename(tmp.c_str(), filename) != 0) {
+		remove(tmp.c_str());
+	}
+}
+
+struct rom_library_stats rom_library_scan(
+		const char *index_file,
+		const char * const *paths,
+		size_t count,
+		struct rom_library_entry *results) {
+	std::lock_guard<std::mutex> lock(scan_mutex);
+
+	rom_index index;
+	if (index_file != nullptr) {
+		load_index(index_file, index);
+	}
+
+	/*
+	 * The index is only read during the scan, and each worker only writes
+	 * its own slots of the output arrays, so no locking is needed until
+	 * the results are merged back in afterwards.
+	 */
+	enum { CACHED, PARSED, MISSING };
+	std::vector<uint8_t> status(count);
+	std::vector<struct index_entry> scanned(count);
+	std::atomic<size_t> next{0};
+
+	auto worker = [&]() {
+		char error[ROM_HEADER_ERROR_LEN];
+		for (size_t i = next++; i < count; i = next++) {
+			struct stat st{};
+			if (paths[i] == nullptr || stat(paths[i], &st) != 0 || !S_ISREG(st.st_mode)) {
+				results[i] = {};
+				status[i] = MISSING;
+				continue;
+			}
+			struct index_entry &e = scanned[i];
+			e.size = st.st_size;
+			e.mtime_sec = st.st_mtim.tv_sec;
+			e.mtime_nsec = st.st_mtim.tv_nsec;
+
+			auto it = index.find(paths[i]);
+			if (it != index.end()
+					&& it->second.size == e.size
+					&& it->second.mtime_sec == e.mtime_sec
+					&& it->second.mtime_nsec == e.mtime_nsec) {
+				results[i] = it->second.entry;
+				status[i] = CACHED;
+				continue;
+			}
+			e.entry.valid = rom_header_read(paths[i], &e.entry.header, error, sizeof(error));
+			results[i] = e.entry;
+			status[i] = PARSED;
+		}
+	};
+
+	/* Header reads are mostly waiting on storage, so use every core */
+	size_t num_threads = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), count);
+	std::vector<std::thread> threads;
+	for (size_t i = 1; i < num_threads; i++) {
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto &t : threads) {
+		t.join();
+	}
+
+	struct rom_library_stats stats{};
+	bool changed = false;
+	for (size_t i = 0; i < count; i++) {
+		switch (status[i]) {
+			case CACHED:
+				stats.cached++;
+				break;
+			case PARSED:
+				stats.parsed++;
+				index[paths[i]] = scanned[i];
+				changed = true;
+				break;
+			case MISSING:
+				stats.missing++;
+				if (paths[i] != nullptr && index.erase(paths[i]) > 0) {
+					changed = true;
+				}
+				break;
+		}
+	}
+
+	if (index_file != nullptr && changed) {
+		save_index(index_file, index);
+	}
+	return stats;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_ROM_LIBRARY_H
+#define GBCC_ANDROID_ROM_LIBRARY_H
+
+#include <cstddef>
+
+#include "rom_header.h"
+
+struct rom_library_entry {
+	bool valid;  /* False if the file is missing or not a ROM */
+	struct rom_header header;
+};
+
+struct rom_library_stats {
+	size_t cached;  /* Unchanged since the last scan, so not opened at all */
+	size_t parsed;
+	size_t missing;
+};
+
+/*
+ * Read the headers of count ROMs in parallel, writing one entry per path to
+ * results. The index file is keyed by path, size & mtime, so only new or
+ * changed files are actually opened; it's updated afterwards if anything
+ * changed. index_file may be null to skip the index entirely.
+ */
+struct rom_library_stats rom_library_scan(
+		const char *index_file,
+		const char * const *paths,
+		size_t count,
+		struct rom_library_entry *results);
+
+#endif /* GBCC_ANDROID_ROM_LIBRARY_H */
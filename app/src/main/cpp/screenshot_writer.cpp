@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#include "screenshot_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+extern "C" {
+#include <core.h>
+}
+
+#define FRAME_PIXELS (GBCC_SCREEN_WIDTH * GBCC_SCREEN_HEIGHT)
+#define PNG_BYTES_PER_PIXEL 3
+
+enum slot_state : uint8_t {
+	SLOT_FREE,
+	SLOT_FILLING,
+	SLOT_QUEUED
+};
+
+struct slot {
+	std::atomic<uint8_t> state;
+	uint64_t sequence;
+	unsigned int scale;
+	struct timespec time;
+	uint32_t pixels[FRAME_PIXELS];
+};
+
+static struct slot pool[SCREENSHOT_POOL_SIZE];
+static sem_t queued;
+static pthread_t writer;
+static std::atomic<bool> active;
+static std::atomic<bool> stopping;
+static std::atomic<unsigned int> capture_scale{1};
+static std::atomic<uint64_t> next_sequence;
+
+static std::string directory;
+static std::string prefix;
+
+static std::atomic<uint64_t> written;
+static std::atomic<uint64_t> dropped;
+static std::atomic<uint64_t> failed;
+
+static void put_u32(std::vector<uint8_t> *png, uint32_t x) {
+	png->push_back(static_cast<uint8_t>(x >> 24u));
+	png->push_back(static_cast<uint8_t>(x >> 16u));
+	png->push_back(static_cast<uint8_t>(x >> 8u));
+	png->push_back(static_cast<uint8_t>(x));
+}
+
+static void put_chunk(std::vector<uint8_t> *png, const char *type, const uint8_t *data, size_t len) {
+	put_u32(png, static_cast<uint32_t>(len));
+	size_t start = png->size();
+	png->insert(png->end(), type, type + 4);
+	png->insert(png->end(), data, data + len);
+	uLong crc = crc32(0, &(*png)[start], static_cast<uInt>(len + 4));
+	put_u32(png, static_cast<uint32_t>(crc));
+}
+
+bool screenshot_encode_png(const uint32_t *frame, unsigned int scale, std::vector<uint8_t> *png) {
+	const size_t width = GBCC_SCREEN_WIDTH * scale;
+	const size_t height = GBCC_SCREEN_HEIGHT * scale;
+	const size_t stride = 1 + width * PNG_BYTES_PER_PIXEL;
+
+	/*
+	 * Each source row is stored with the Sub filter, which zeroes runs of
+	 * one colour, and its copies with the Up filter, which zeroes them
+	 * entirely, so upscaling costs little beyond the deflate input size.
+	 */
+	std::vector<uint8_t> raw(stride * height);
+	for (size_t y = 0; y < GBCC_SCREEN_HEIGHT; y++) {
+		uint8_t *row = &raw[y * scale * stride];
+		row[0] = 1;
+		uint8_t *out = &row[1];
+		uint8_t last[PNG_BYTES_PER_PIXEL] = {0};
+		for (size_t x = 0; x < GBCC_SCREEN_WIDTH; x++) {
+			// PPU pixels are 0xRRGGBBAA
+			uint32_t pixel = frame[y * GBCC_SCREEN_WIDTH + x];
+			const uint8_t rgb[PNG_BYTES_PER_PIXEL] = {
+				static_cast<uint8_t>(pixel >> 24u),
+				static_cast<uint8_t>(pixel >> 16u),
+				static_cast<uint8_t>(pixel >> 8u)
+			};
+			for (unsigned int s = 0; s < scale; s++) {
+				for (int c = 0; c < PNG_BYTES_PER_PIXEL; c++) {
+					*out++ = static_cast<uint8_t>(rgb[c] - last[c]);
+					last[c] = rgb[c];
+				}
+			}
+		}
+		for (unsigned int s = 1; s < scale; s++) {
+			row[s * stride] = 2;
+		}
+	}
+
+	uLongf deflated_len = compressBound(static_cast<uLong>(raw.size()));
+	std::vector<uint8_t> deflated(deflated_len);
+	if (compress2(deflated.data(), &deflated_len, raw.data(), static_cast<uLong>(raw.size()), Z_DEFAULT_COMPRESSION) != Z_OK) {
+		return false;
+	}
+
+	static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	png->clear();
+	png->insert(png->end(), signature, signature + sizeof(signature));
+
+	std::vector<uint8_t> header;
+	put_u32(&header, static_cast<uint32_t>(width));
+	put_u32(&header, static_cast<uint32_t>(height));
+	header.push_back(8);  /* Bit depth */
+	header.push_back(2);  /* Truecolour */
+	header.push_back(0);  /* Deflate */
+	header.push_back(0);  /* Adaptive filtering */
+	header.push_back(0);  /* No interlace */
+	put_chunk(png, "IHDR", header.data(), header.size());
+	put_chunk(png, "IDAT", deflated.data(), deflated_len);
+	put_chunk(png, "IEND", nullptr, 0);
+	return true;
+}
+
+static bool write_file(const std::string &path, const std::vector<uint8_t> &data) {
+	// Write under a temporary name, so a half-written file is never left behind
+	std::string tmp = path + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	const uint8_t *buf = data.data();
+	size_t len = data.size();
+	while (len > 0) {
+		ssize_t ret = write(fd, buf, len);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			close(fd);
+			unlink(tmp.c_str());
+			return false;
+		}
+		buf += ret;
+		len -= static_cast<size_t>(ret);
+	}
+	if (close(fd) != 0 || rename(tmp.c_str(), path.c_str()) != 0) {
+		unlink(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+static std::string screenshot_path(const struct timespec *time) {
+	struct tm tm{};
+	localtime_r(&time->tv_sec, &tm);
+	char stamp[32];
+	size_t len = strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+	snprintf(stamp + len, sizeof(stamp) - len, "-%03ld", time->tv_nsec / 1000000);
+	return directory + "/" + prefix + "-" + stamp + ".png";
+}
+
+static struct slot *oldest_queued() {
+	struct slot *oldest = nullptr;
+	for (auto &s : pool) {
+		if (s.state.load(std::memory_order_acquire) == SLOT_QUEUED
+				&& (oldest == nullptr || s.sequence < oldest->sequence)) {
+			oldest = &s;
+		}
+	}
+	return oldest;
+}
+
+static void *writer_thread(void *arg) {
+	(void) arg;
+	std::vector<uint8_t> png;
+	while (true) {
+		if (sem_wait(&queued) != 0) {
+			continue;
+		}
+		// Every capture posts once, so the stop request is only seen once they're all done
+		struct slot *s = oldest_queued();
+		if (s == nullptr) {
+			if (stopping.load()) {
+				break;
+			}
+			continue;
+		}
+		if (screenshot_encode_png(s->pixels, s->scale, &png)
+				&& write_file(screenshot_path(&s->time), png)) {
+			written.fetch_add(1, std::memory_order_relaxed);
+		} else {
+			failed.fetch_add(1, std::memory_order_relaxed);
+		}
+		s->state.store(SLOT_FREE, std::memory_order_release);
+	}
+	return nullptr;
+}
+
+bool screenshot_begin(const char *dir, const char *name) {
+	if (active.load()) {
+		return true;
+	}
+	if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+		return false;
+	}
+	directory = dir;
+	prefix = name;
+	for (auto &s : pool) {
+		s.state.store(SLOT_FREE);
+	}
+	sem_init(&queued, 0, 0);
+	stopping.store(false);
+	if (pthread_create(&writer, nullptr, writer_thread, nullptr) != 0) {
+		sem_destroy(&queued);
+		return false;
+	}
+	active.store(true);
+	return true;
+}
+
+void screenshot_end() {
+	if (!active.load()) {
+		return;
+	}
+	active.store(false);
+	stopping.store(true);
+	sem_post(&queued);
+	pthread_join(writer, nullptr);
+	sem_destroy(&queued);
+}
+
+void screenshot_set_scale(unsigned int s) {
+	capture_scale.store(std::min(std::max(s, 1u), static_cast<unsigned int>(SCREENSHOT_MAX_SCALE)));
+}
+
+bool screenshot_capture(const uint32_t *frame) {
+	if (!active.load(std::memory_order_relaxed)) {
+		return false;
+	}
+	for (auto &s : pool) {
+		uint8_t expected = SLOT_FREE;
+		if (!s.state.compare_exchange_strong(expected, SLOT_FILLING, std::memory_order_acquire)) {
+			continue;
+		}
+		memcpy(s.pixels, frame, sizeof(s.pixels));
+		clock_gettime(CLOCK_REALTIME, &s.time);
+		s.scale = capture_scale.load(std::memory_order_relaxed);
+		s.sequence = next_sequence.fetch_add(1, std::memory_order_relaxed);
+		s.state.store(SLOT_QUEUED, std::memory_order_release);
+		sem_post(&queued);
+		return true;
+	}
+	dropped.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+struct screenshot_stats screenshot_get_stats() {
+	struct screenshot_stats stats{};
+	stats.written = written.load();
+	stats.dropped = dropped.load();
+	stats.failed = failed.load();
+	return stats;
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_SCREENSHOT_WRITER_H
+#define GBCC_ANDROID_SCREENSHOT_WRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define SCREENSHOT_POOL_SIZE 4
+#define SCREENSHOT_MAX_SCALE 8
+
+/*
+ * Asynchronous screenshots of the native-resolution frame.
+ *
+ * screenshot_capture copies the frame into a free buffer from a small pool
+ * and hands it to a background thread, which upscales, PNG-encodes and
+ * writes it out, so the caller only ever pays for one memcpy. If every
+ * buffer is still waiting to be written, the capture is dropped instead.
+ *
+ * Frames are taken as they leave the PPU, with the palette already applied,
+ * so the output matches what the shaders are given rather than the scaled
+ * surface.
+ */
+
+struct screenshot_stats {
+	uint64_t written;
+	uint64_t dropped;  /* No free buffer at capture time */
+	uint64_t failed;   /* Encoding or writing failed */
+};
+
+/* Start the writer, saving to directory/prefix-<time>.png */
+bool screenshot_begin(const char *directory, const char *prefix);
+
+/* Write out anything still queued, then stop the writer */
+void screenshot_end();
+
+/* Integer upscale applied to later captures, from 1 to SCREENSHOT_MAX_SCALE */
+void screenshot_set_scale(unsigned int scale);
+
+/* Safe from any thread, never blocks; returns false if the capture was dropped */
+bool screenshot_capture(const uint32_t *frame);
+
+struct screenshot_stats screenshot_get_stats();
+
+/* Encode a GBCC_SCREEN_WIDTH x GBCC_SCREEN_HEIGHT frame as an RGB PNG */
+bool screenshot_encode_png(const uint32_t *frame, unsigned int scale, std::vector<uint8_t> *png);
+
+#endif /* GBCC_ANDROID_SCREENSHOT_WRITER_H */
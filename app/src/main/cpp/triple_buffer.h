@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2019-2020 Philip Jones
+ *
+ * Licensed under the MIT License.
+ * See either the LICENSE file, or:
+ *
+ * https://opensource.org/licenses/MIT
+ *
+ */
+
+#ifndef GBCC_ANDROID_TRIPLE_BUFFER_H
+#define GBCC_ANDROID_TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Lock-free single-producer, single-consumer triple buffer index.
+ *
+ * This only hands out slot indices 0-2; the caller owns the actual storage.
+ * The producer fills its back slot then publishes it, and the consumer
+ * acquires the newest published slot, so neither side ever waits and the
+ * consumer never sees a half-written slot.
+ */
+#define TRIPLE_BUFFER_INDEX_MASK 0x03u
+#define TRIPLE_BUFFER_FRESH 0x04u
+
+struct triple_buffer {
+	uint8_t back = 0;
+	std::atomic<uint8_t> middle{1};
+	uint8_t front = 2;
+
+	/* Statistics, readable from any thread */
+	std::atomic<uint64_t> published{0};
+	std::atomic<uint64_t> dropped{0};  /* Overwritten before being acquired */
+	std::atomic<uint64_t> reused{0};   /* Acquires with nothing new published */
+};
+
+/* Producer: the slot to write the next frame into */
+static inline uint8_t triple_buffer_back(const struct triple_buffer *tb) {
+	return tb->back;
+}
+
+/* Producer: publish the back slot, returning true if an unread frame was dropped */
+static inline bool triple_buffer_publish(struct triple_buffer *tb) {
+	uint8_t old = tb->middle.exchange(tb->back | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel);
+	tb->back = old & TRIPLE_BUFFER_INDEX_MASK;
+	tb->published.fetch_add(1, std::memory_order_relaxed);
+	if (old & TRIPLE_BUFFER_FRESH) {
+		tb->dropped.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+/*
+ * Consumer: the newest complete slot, which stays valid until the next
+ * acquire. fresh is set if it was published since the last acquire.
+ */
+static inline uint8_t triple_buffer_acquire_fresh(struct triple_buffer *tb, bool *fresh) {
+	if (!(tb->middle.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH)) {
+		tb->reused.fetch_add(1, std::memory_order_relaxed);
+		*fresh = false;
+		return tb->front;
+	}
+	uint8_t old = tb->middle.exchange(tb->front, std::memory_order_acq_rel);
+	tb->front = old & TRIPLE_BUFFER_INDEX_MASK;
+	*fresh = true;
+	return tb->front;
+}
+
+static inline uint8_t triple_buffer_acquire(struct triple_buffer *tb) {
+	bool fresh;
+	return triple_buffer_acquire_fresh(tb, &fresh);
+}
+
+#endif /* GBCC_ANDROID_TRIPLE_BUFFER_H */
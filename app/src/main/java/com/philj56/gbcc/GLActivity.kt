@@ -81,6 +81,15 @@ private const val BUTTON_CODE_DOWN = 5
 private const val BUTTON_CODE_LEFT = 6
 private const val BUTTON_CODE_RIGHT = 7
 
+// Must match EMULATOR_* in gbcc.cpp
+private const val EMULATOR_STATE_TURBO = 1 shl 0
+private const val EMULATOR_STATE_PRINTER_CONNECTED = 1 shl 1
+private const val EMULATOR_STATE_PRINTING = 1 shl 2
+private const val EMULATOR_STATE_RUMBLE = 1 shl 3
+private const val EMULATOR_STATE_ERROR = 1 shl 4
+private const val EMULATOR_CHANGED_SHIFT = 8
+private const val EMULATOR_EVENT_START_PRINTING = 1 shl 16
+
 private val KEYCODE_TO_STRING_MAP = mapOf(
         KeyEvent.KEYCODE_BUTTON_A to "button_map_a",
         KeyEvent.KEYCODE_BUTTON_B to "button_map_b",
@@ -120,6 +129,8 @@ private val ACTION_TO_KEY_MAP = mapOf(
     "menu" to 16,
     "interlace" to 17,
     "shader" to 18,
+    "screenshot" to 19,
+    "record" to 20,
     "back" to -1,
     "unmapped" to -1
 )
@@ -137,21 +148,22 @@ class GLActivity : BaseActivity(), SensorEventListener {
     }
 
     private lateinit var prefs: SharedPreferences
-    private val handler = Handler(Looper.getMainLooper())
     private val executor = Executors.newSingleThreadExecutor()
     private lateinit var gestureDetector : GestureDetector
     private lateinit var sensorManager : SensorManager
     private var accelerometer : Sensor? = null
     private lateinit var vibrator : Vibrator
-    private lateinit var checkEmulatorState : Runnable
     private lateinit var filename : String
     private lateinit var printerAudio : AudioTrack
     private lateinit var printerPaperTearSound : SoundPool
     private var printerAudioLength = 0
+    private var emulatorStatus = 0
     private var resume = false
     private var resumePrinting = false
     private var reboot = false
     private var loadedSuccessfully = false
+    // Native emulator handle, valid between startGBCC() and stopGBCC()
+    private var emulator = 0L
     private var cameraPermissionRefused = false
     private var animateButtons = true
     private var dpadState = 0
@@ -164,7 +176,7 @@ class GLActivity : BaseActivity(), SensorEventListener {
     private var disableAccelerometer = false
     private lateinit var saveDir : String
     private var tempOptions : ByteArray? = null
-    private var printerByteArray : ByteArray = ByteArray(0)
+    private var printerImage : ByteBuffer? = null
     private val additionalMappings = mutableMapOf<Int, String>()
     private val transitionToPrinter = AnimatorSet()
     private val transitionToGameboy = AnimatorSet()
@@ -174,8 +186,10 @@ class GLActivity : BaseActivity(), SensorEventListener {
     private lateinit var binding: ActivityGlBinding
 
     private external fun chdir(dirName: String)
+    private external fun createEmulator(): Long
     private external fun checkRom(file: String): Boolean
     private external fun loadRom(
+        emulator: Long,
         file: String,
         sampleRate: Int,
         samplesPerBuffer: Int,
@@ -184,21 +198,28 @@ class GLActivity : BaseActivity(), SensorEventListener {
         cheatFile: String?,
         prefs: SharedPreferences
     ): Boolean
-    private external fun getErrorMessage(): String
-    private external fun quit()
-    private external fun press(button: Int, pressed: Boolean)
-    private external fun isPressed(button: Int) : Boolean
-    private external fun toggleTurbo(): Boolean
-    private external fun toggleMenu()
-    private external fun saveState(state: Int)
-    private external fun loadState(state: Int)
-    private external fun getOptions(): ByteArray
+    private external fun getErrorMessage(emulator: Long): String
+    private external fun quit(emulator: Long)
+    private external fun press(emulator: Long, button: Int, pressed: Boolean)
+    private external fun isPressed(emulator: Long, button: Int) : Boolean
+    private external fun toggleTurbo(emulator: Long): Boolean
+    private external fun toggleMenu(emulator: Long)
+    private external fun saveState(emulator: Long, state: Int)
+    private external fun loadState(emulator: Long, state: Int)
+    private external fun getOptions(emulator: Long): ByteArray
     private external fun setOptions(options: ByteArray)
-    private external fun checkVibrationFun(): Boolean
-    private external fun checkErrorFun(): Boolean
-    private external fun checkTurboFun(): Boolean
+    private external fun registerEmulatorEvents(emulator: Long)
+    private external fun unregisterEmulatorEvents()
     private external fun flushLogs()
-    private external fun updateAccelerometer(x: Float, y: Float)
+    /**
+     * Per-frame timing histogram summaries, in microseconds. For each of
+     * emulation, vsync wait, render, present interval, input latency and
+     * audio fill, there are six values: count, mean, p50, p90, p99 and max.
+     * The same summary is written to gbcc.log when emulation stops; this is
+     * for instrumentation and debugging, so is kept in proguard-rules.pro.
+     */
+    external fun getFrameMetrics(): LongArray
+    private external fun updateAccelerometer(emulator: Long, x: Float, y: Float)
     private external fun updateCamera(
         array: ByteBuffer,
         width: Int,
@@ -209,75 +230,69 @@ class GLActivity : BaseActivity(), SensorEventListener {
     private external fun initialiseTileset(width: Int, height: Int, data: ByteArray)
     private external fun destroyTileset()
     private external fun setCameraImage(data: ByteArray)
-    private external fun hasRumble(): Boolean
-    private external fun hasAccelerometer(): Boolean
-    private external fun isCamera(): Boolean
-    private external fun printerConnected(): Boolean
-    private external fun shouldStartPrinting(): Boolean
-    private external fun isPrinting(): Boolean
-    private external fun updatePrinter(): Boolean
-    private external fun getPrinterStrip(): ByteArray
-    private external fun resetPrinter()
-
-
-    init {
-        checkEmulatorState = Runnable {
-            if (printerConnected()) {
-                binding.printerTransitionButton.visibility = View.VISIBLE
-            } else {
-                binding.printerTransitionButton.visibility = View.GONE
-            }
-            if (shouldStartPrinting() || (isPrinting() && (printerAudio.playState != AudioTrack.PLAYSTATE_PLAYING))) {
-                if (printerConnected()) {
-                    print()
-                } else {
-                    // Something went wrong, reset the printer to be safe
-                    resetPrinter()
-                }
-            }
-            if (checkVibrationFun()) {
-                rumblePakVibrate(prefs.getInt("rumble_strength", 255))
-            }
-            val turbo = checkTurboFun()
-            if (binding.turboToggle.isChecked != turbo) {
-                binding.turboToggle.isChecked = turbo
-            }
-            if (checkErrorFun()) {
-                flushLogs()
-                MaterialAlertDialogBuilder(this)
-                    .setTitle(R.string.invalid_opcode_title)
-                    .setMessage(R.string.invalid_opcode_description)
-                    .setPositiveButton(R.string.button_send_feedback) { _, _ ->
-                        val intent = Intent(Intent.ACTION_SENDTO).apply {
-                            data = Uri.parse("mailto:")
-                            putExtra(
-                                Intent.EXTRA_EMAIL,
-                                arrayOf("gbcc.emu+invalid_opcode@gmail.com")
-                            )
-                            putExtra(Intent.EXTRA_SUBJECT, "Bug report")
-                            putExtra(
-                                Intent.EXTRA_TEXT,
-                                "Crash log:\n----------\n" + filesDir.resolve("gbcc.log").readText()
-                            )
-                        }
-                        try {
-                            startActivity(intent)
-                        } catch (e: ActivityNotFoundException) {
-                            Toast.makeText(
-                                this,
-                                R.string.message_no_email_app,
-                                Toast.LENGTH_SHORT
-                            ).show()
-                        }
-                        finish()
-                    }.setNegativeButton(R.string.button_quit) { _, _ ->
-                        finish()
-                    }.setCancelable(false)
-                    .create()
-                    .show()
-            } else {
-                handler.postDelayed(checkEmulatorState, 10)
-            }
+    private external fun hasRumble(emulator: Long): Boolean
+    private external fun hasAccelerometer(emulator: Long): Boolean
+    private external fun isCamera(emulator: Long): Boolean
+    private external fun updatePrinter(emulator: Long): Boolean
+    private external fun getPrinterImage(): ByteBuffer?
+    private external fun setPrinterImage(data: ByteArray)
+    private external fun clearPrinterImage()
+    private external fun resetPrinter(emulator: Long)
+
+
+    // Called from native code on the UI thread, whenever the emulator state changes
+    @Suppress("unused")
+    private fun onEmulatorEvents(status: Int) {
+        emulatorStatus = status
+        val changed = status shr EMULATOR_CHANGED_SHIFT
+        val printerConnected = (status and EMULATOR_STATE_PRINTER_CONNECTED) != 0
+        if (printerConnected) {
+            binding.printerTransitionButton.visibility = View.VISIBLE
+        } else {
+            binding.printerTransitionButton.visibility = View.GONE
+        }
+        checkPrinter((status and EMULATOR_EVENT_START_PRINTING) != 0)
+        if ((changed and EMULATOR_STATE_RUMBLE) != 0) {
+            rumblePakVibrate(prefs.getInt("rumble_strength", 255))
+        }
+        val turbo = (status and EMULATOR_STATE_TURBO) != 0
+        if (binding.turboToggle.isChecked != turbo) {
+            binding.turboToggle.isChecked = turbo
+        }
+        if ((status and EMULATOR_STATE_ERROR) != 0) {
+            unregisterEmulatorEvents()
+            flushLogs()
+            MaterialAlertDialogBuilder(this)
+                .setTitle(R.string.invalid_opcode_title)
+                .setMessage(R.string.invalid_opcode_description)
+                .setPositiveButton(R.string.button_send_feedback) { _, _ ->
+                    val intent = Intent(Intent.ACTION_SENDTO).apply {
+                        data = Uri.parse("mailto:")
+                        putExtra(
+                            Intent.EXTRA_EMAIL,
+                            arrayOf("gbcc.emu+invalid_opcode@gmail.com")
+                        )
+                        putExtra(Intent.EXTRA_SUBJECT, "Bug report")
+                        putExtra(
+                            Intent.EXTRA_TEXT,
+                            "Crash log:\n----------\n" + filesDir.resolve("gbcc.log").readText()
+                        )
+                    }
+                    try {
+                        startActivity(intent)
+                    } catch (e: ActivityNotFoundException) {
+                        Toast.makeText(
+                            this,
+                            R.string.message_no_email_app,
+                            Toast.LENGTH_SHORT
+                        ).show()
+                    }
+                    finish()
+                }.setNegativeButton(R.string.button_quit) { _, _ ->
+                    finish()
+                }.setCancelable(false)
+                .create()
+                .show()
         }
     }
 
@@ -338,7 +353,7 @@ class GLActivity : BaseActivity(), SensorEventListener {
                 when (motionEvent.action) {
                     MotionEvent.ACTION_DOWN -> {
                         if (!button.isPressed) {
-                            press(button.id, true)
+                            press(emulator, button.id, true)
                         }
                         button.isNormalPressed = true
                         button.view.isPressed = true && animateButtons
@@ -353,7 +368,7 @@ class GLActivity : BaseActivity(), SensorEventListener {
                                 button2.isMotionPressed = false
                             }
                             if (lastPressed && !button2.isPressed) {
-                                press(button2.id, false)
+                                press(emulator, button2.id, false)
                                 button2.view.isPressed = false
                                 hapticVibrate(button2.view, false)
                             }
@@ -369,7 +384,7 @@ class GLActivity : BaseActivity(), SensorEventListener {
                                 val pressed = button2.isPressed
                                 if (pressed != lastPressed) {
                                     hapticVibrate(button2.view, pressed)
-                                    press(button2.id, pressed)
+                                    press(emulator, button2.id, pressed)
                                     button2.view.isPressed = pressed && animateButtons
                                 }
                             }
@@ -399,8 +414,8 @@ class GLActivity : BaseActivity(), SensorEventListener {
         }
         window.setBackgroundDrawableResource(bgColor)
 
-        binding.screen.setOnClickListener { toggleMenu() }
-        binding.turboToggle.setOnClickListener { toggleTurbo() }
+        binding.screen.setOnClickListener { toggleMenu(emulator) }
+        binding.turboToggle.setOnClickListener { toggleTurbo(emulator) }
 
         if (!gbc) {
             val screenBorderColor: Int
@@ -524,7 +539,7 @@ class GLActivity : BaseActivity(), SensorEventListener {
         if (!checkRom(filename)) {
             Toast.makeText(
                 this,
-                "Error loading ROM:\n" + getErrorMessage().trim(),
+                "Error loading ROM:\n" + getErrorMessage(emulator).trim(),
                 Toast.LENGTH_SHORT
             ).show()
             finish()
@@ -551,15 +566,18 @@ class GLActivity : BaseActivity(), SensorEventListener {
 
         checkFiles()
 
-        if (savedInstanceState != null) {
+        if (savedInstanceState == null) {
+            // The printout lives in native memory, so may be left over from a previous game
+            clearPrinterImage()
+        } else {
             resume = resume || savedInstanceState.getBoolean("resume")
             resumePrinting = resumePrinting || savedInstanceState.getBoolean("resumePrinting")
             if (tempOptions == null) {
                 tempOptions = savedInstanceState.getByteArray("options")
             }
-            if (printerByteArray.isEmpty()) {
+            if (getPrinterImage() == null) {
                 savedInstanceState.getByteArray("printerByteArray")?.let {
-                    printerByteArray = it
+                    setPrinterImage(it)
                 }
             }
             if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.TIRAMISU) {
@@ -572,6 +590,8 @@ class GLActivity : BaseActivity(), SensorEventListener {
             }
         }
 
+        printerImage = getPrinterImage()
+
         animateButtons = prefs.getBoolean("animate_buttons", true)
         setButtonIds(
             arrayOf(
@@ -743,7 +763,9 @@ class GLActivity : BaseActivity(), SensorEventListener {
             if (it.exists()) it else null
         }
         tempOptions?.let { setOptions(it) }
+        emulator = createEmulator()
         loadedSuccessfully = loadRom(
+            emulator,
             filename,
             sampleRate,
             framesPerBuffer,
@@ -757,9 +779,11 @@ class GLActivity : BaseActivity(), SensorEventListener {
         if (!loadedSuccessfully) {
             Toast.makeText(
                 this,
-                "Error loading ROM:\n" + getErrorMessage().trim(),
+                "Error loading ROM:\n" + getErrorMessage(emulator).trim(),
                 Toast.LENGTH_SHORT
             ).show()
+            quit(emulator)
+            emulator = 0L
             finish()
             return
         }
@@ -785,9 +809,9 @@ class GLActivity : BaseActivity(), SensorEventListener {
                 )
             }
         }
-        handler.post(checkEmulatorState)
+        registerEmulatorEvents(emulator)
         if (!reboot && (resume || prefs.getBoolean("auto_resume", false))) {
-            loadState(autoSaveState)
+            loadState(emulator, autoSaveState)
             binding.turboToggle.isChecked = false
             resume = false
         }
@@ -796,10 +820,10 @@ class GLActivity : BaseActivity(), SensorEventListener {
             resumePrinting = false
         }
         reboot = false
-        if (hasAccelerometer()) {
+        if (hasAccelerometer(emulator)) {
             sensorManager.registerListener(this, accelerometer, 10000)
         }
-        if (isCamera()) {
+        if (isCamera(emulator)) {
             if (checkCameraPermission()) {
                 startCamera()
             } else if (!cameraPermissionRefused) {
@@ -814,11 +838,12 @@ class GLActivity : BaseActivity(), SensorEventListener {
         if (loadedSuccessfully) {
             resumePrinting = (printerAudio.playState == AudioTrack.PLAYSTATE_PLAYING)
             stopPrinting()
-            tempOptions = getOptions()
+            tempOptions = getOptions(emulator)
             sensorManager.unregisterListener(this)
-            handler.removeCallbacks(checkEmulatorState)
-            saveState(autoSaveState)
-            quit()
+            unregisterEmulatorEvents()
+            saveState(emulator, autoSaveState)
+            quit(emulator)
+            emulator = 0L
             resume = true
         }
     }
@@ -840,7 +865,11 @@ class GLActivity : BaseActivity(), SensorEventListener {
         outState.putBoolean("resume", true)
         outState.putBoolean("resumePrinting", resumePrinting)
         outState.putByteArray("options", tempOptions)
-        outState.putByteArray("printerByteArray", printerByteArray)
+        printerImage?.let {
+            val bytes = ByteArray(it.capacity())
+            it.duplicate().apply { rewind() }.get(bytes)
+            outState.putByteArray("printerByteArray", bytes)
+        }
         outState.putSerializable("currentScreen", currentScreen)
     }
 
@@ -857,10 +886,10 @@ class GLActivity : BaseActivity(), SensorEventListener {
                     windowManager.defaultDisplay.rotation
                 }
             when (rotation) {
-                Surface.ROTATION_0 -> updateAccelerometer(event.values[0], event.values[1])
-                Surface.ROTATION_90 -> updateAccelerometer(-event.values[1], event.values[0])
-                Surface.ROTATION_180 -> updateAccelerometer(-event.values[0], -event.values[1])
-                Surface.ROTATION_270 -> updateAccelerometer(event.values[1], -event.values[0])
+                Surface.ROTATION_0 -> updateAccelerometer(emulator, event.values[0], event.values[1])
+                Surface.ROTATION_90 -> updateAccelerometer(emulator, -event.values[1], event.values[0])
+                Surface.ROTATION_180 -> updateAccelerometer(emulator, -event.values[0], -event.values[1])
+                Surface.ROTATION_270 -> updateAccelerometer(emulator, event.values[1], -event.values[0])
             }
         }
     }
@@ -1069,7 +1098,7 @@ class GLActivity : BaseActivity(), SensorEventListener {
 
             fun tiltValue(x: Float, y: Float) {
                 val g = 9.81f
-                updateAccelerometer(-g * x, g * y)
+                updateAccelerometer(emulator, -g * x, g * y)
                 disableAccelerometer = true
             }
 
@@ -1140,7 +1169,7 @@ class GLActivity : BaseActivity(), SensorEventListener {
         when (action) {
             "back" -> onBackPressedDispatcher.onBackPressed()
             "turbo" -> if (pressed) toggleTurboWrapper()
-            else -> press(button, pressed)
+            else -> press(emulator, button, pressed)
         }
         return true
     }
@@ -1152,24 +1181,24 @@ class GLActivity : BaseActivity(), SensorEventListener {
         val toggledOff = (lastState or dpadState) xor dpadState
 
         if (toggledOn and 1 > 0) {
-            press(BUTTON_CODE_UP, true)
+            press(emulator, BUTTON_CODE_UP, true)
         } else if (toggledOff and 1 > 0) {
-            press(BUTTON_CODE_UP, false)
+            press(emulator, BUTTON_CODE_UP, false)
         }
         if (toggledOn and 2 > 0) {
-            press(BUTTON_CODE_DOWN, true)
+            press(emulator, BUTTON_CODE_DOWN, true)
         } else if (toggledOff and 2 > 0) {
-            press(BUTTON_CODE_DOWN, false)
+            press(emulator, BUTTON_CODE_DOWN, false)
         }
         if (toggledOn and 4 > 0) {
-            press(BUTTON_CODE_LEFT, true)
+            press(emulator, BUTTON_CODE_LEFT, true)
         } else if (toggledOff and 4 > 0) {
-            press(BUTTON_CODE_LEFT, false)
+            press(emulator, BUTTON_CODE_LEFT, false)
         }
         if (toggledOn and 8 > 0) {
-            press(BUTTON_CODE_RIGHT, true)
+            press(emulator, BUTTON_CODE_RIGHT, true)
         } else if (toggledOff and 8 > 0) {
-            press(BUTTON_CODE_RIGHT, false)
+            press(emulator, BUTTON_CODE_RIGHT, false)
         }
 
         return (toggledOn or toggledOff) > 0
@@ -1196,7 +1225,7 @@ class GLActivity : BaseActivity(), SensorEventListener {
     }
 
     private fun toggleTurboWrapper() {
-        val turbo = toggleTurbo()
+        val turbo = toggleTurbo(emulator)
         binding.turboToggle.isChecked = turbo
     }
 
@@ -1283,12 +1312,9 @@ class GLActivity : BaseActivity(), SensorEventListener {
                 return@registerForActivityResult
             }
             Thread {
-                printerByteArray.let {
-                    if (it.isEmpty()) {
-                        return@Thread
-                    }
+                printerImage?.let {
                     val width = 160
-                    val height = it.size / 160
+                    val height = it.capacity() / 160
                     val bitmap = Bitmap.createBitmap(
                         width,
                         height,
@@ -1332,7 +1358,8 @@ class GLActivity : BaseActivity(), SensorEventListener {
 
             // Reset the actual paper
             printerScrollAnimation.cancel()
-            printerByteArray = ByteArray(0)
+            clearPrinterImage()
+            printerImage = null
             updatePrinterImage(false)
 
             // Animate the torn paper
@@ -1410,17 +1437,17 @@ class GLActivity : BaseActivity(), SensorEventListener {
                     stop = false
                     printerAudio.stop()
                     printerAudio.reloadStaticData()
+                    // The game may have started another print while this one finished
+                    checkPrinter(false)
                     return
                 }
-                val finished = updatePrinter()
-                val strip = getPrinterStrip()
-                if (strip.isEmpty()) {
+                val oldSize = printerImage?.capacity() ?: 0
+                val finished = updatePrinter(emulator)
+                printerImage = getPrinterImage()
+                if ((printerImage?.capacity() ?: 0) == oldSize) {
                     stop = true
                     return
                 }
-                val oldSize = printerByteArray.size
-                printerByteArray = printerByteArray.copyOf(oldSize + strip.size)
-                strip.copyInto(printerByteArray, oldSize)
                 updatePrinterImage(true)
 
                 printerAudio.notificationMarkerPosition += data.size
@@ -1440,7 +1467,7 @@ class GLActivity : BaseActivity(), SensorEventListener {
         val portrait = (resources.configuration.orientation == Configuration.ORIENTATION_PORTRAIT)
 
         val printoutWidthPX = 160  // Image width in Game boy Pixels
-        val printoutHeightPX = printerByteArray.size / printoutWidthPX
+        val printoutHeightPX = (printerImage?.capacity() ?: 0) / printoutWidthPX
         val printoutWidthDP = 128f // Width of printout on paper
         val paperWidthDP = 192f  // Width of paper in printer drawable
         val printerWidthDP = 360f  // Width of printer drawable
@@ -1459,8 +1486,9 @@ class GLActivity : BaseActivity(), SensorEventListener {
         val dpPerPX = printoutWidthDP / printoutWidthPX
 
         val paper = binding.printerPaper
-        if (printoutHeightPX > 0) {
-            paper.setImageDrawable(PrinterDrawable(printerByteArray, !portrait))
+        val image = printerImage
+        if (image != null && printoutHeightPX > 0) {
+            paper.setImageDrawable(PrinterDrawable(image, !portrait))
             binding.printerClearButton.isEnabled = true
             binding.printerSaveButton.isEnabled = true
         } else {
@@ -1527,8 +1555,8 @@ class GLActivity : BaseActivity(), SensorEventListener {
     private fun updatePrinterPaperTear() {
         val portrait = (resources.configuration.orientation == Configuration.ORIENTATION_PORTRAIT)
         val paper = binding.printerPaperTear
-        if (printerByteArray.isNotEmpty()) {
-            paper.setImageDrawable(PrinterDrawable(printerByteArray, !portrait))
+        printerImage?.let {
+            paper.setImageDrawable(PrinterDrawable(it, !portrait))
         }
 
         paper.layoutParams.width = binding.printerPaper.layoutParams.width
@@ -1555,6 +1583,20 @@ class GLActivity : BaseActivity(), SensorEventListener {
         layout.rotation = 0f
     }
 
+    // Events only arrive on a change, so this is also re-run once an animated print stops
+    private fun checkPrinter(startPrinting: Boolean) {
+        val printerConnected = (emulatorStatus and EMULATOR_STATE_PRINTER_CONNECTED) != 0
+        val printing = (emulatorStatus and EMULATOR_STATE_PRINTING) != 0
+        if (startPrinting || (printing && (printerAudio.playState != AudioTrack.PLAYSTATE_PLAYING))) {
+            if (printerConnected) {
+                print()
+            } else {
+                // Something went wrong, reset the printer to be safe
+                resetPrinter(emulator)
+            }
+        }
+    }
+
     private fun print() {
         if (currentScreen != Screen.PRINTER) {
             binding.printerTransitionButton.performClick()
@@ -1564,21 +1606,13 @@ class GLActivity : BaseActivity(), SensorEventListener {
             printerAudio.notificationMarkerPosition = PRINTER_UPDATE_SAMPLES
             printerAudio.play()
         } else {
-            var finished = updatePrinter()
-            var strip = getPrinterStrip()
-            while (strip.isNotEmpty()) {
-                val oldSize = printerByteArray.size
-                printerByteArray = printerByteArray.copyOf(oldSize + strip.size)
-                strip.copyInto(printerByteArray, oldSize)
-                updatePrinterImage(false)
-
-                if (finished) {
-                    break
-                } else {
-                    finished = updatePrinter()
-                    strip = getPrinterStrip()
-                }
-            }
+            var oldSize: Int
+            do {
+                oldSize = printerImage?.capacity() ?: 0
+                val finished = updatePrinter(emulator)
+                printerImage = getPrinterImage()
+            } while (!finished && (printerImage?.capacity() ?: 0) != oldSize)
+            updatePrinterImage(false)
         }
     }
 
@@ -1700,7 +1734,7 @@ class MyGLRenderer : GLSurfaceView.Renderer {
     private external fun resizeWindow(width: Int, height: Int)
 }
 
-class PrinterDrawable(byteArray: ByteArray, private val landscape: Boolean) : Drawable() {
+class PrinterDrawable(buffer: ByteBuffer, private val landscape: Boolean) : Drawable() {
     private val bitmap : Bitmap
     private val whitePaint: Paint = Paint().apply { setARGB(255, 255, 255, 255) }
     private val blackPaint: Paint = Paint().apply {
@@ -1711,10 +1745,10 @@ class PrinterDrawable(byteArray: ByteArray, private val landscape: Boolean) : Dr
     init {
         bitmap = Bitmap.createBitmap(
             160,
-            byteArray.size / 160,
+            buffer.capacity() / 160,
             Bitmap.Config.ALPHA_8
         )
-        bitmap.copyPixelsFromBuffer(ByteBuffer.wrap(byteArray))
+        bitmap.copyPixelsFromBuffer(buffer.duplicate().apply { rewind() })
     }
 
     override fun draw(canvas: Canvas) {
@@ -56,6 +56,7 @@ import java.util.zip.ZipOutputStream
 
 private const val BACK_DELAY: Int = 2000
 private const val SAVE_DIR: String = "saves"
+private const val ROM_INDEX: String = "rom_index"
 const val IMPORTED_SAVE_SUBDIR: String = "imported"
 
 class MainActivity : BaseActivity() {
@@ -72,6 +73,7 @@ class MainActivity : BaseActivity() {
     private lateinit var binding: ActivityMainBinding
 
     private var timeBackPressed: Long = 0
+    private var scanGeneration: Int = 0
 
     private val fileAdapter = FileAdapter(
         onClick = { file, view -> onListItemClick(file, view) },
@@ -202,6 +204,26 @@ class MainActivity : BaseActivity() {
             )
         )?.toCollection(ArrayList()) ?: ArrayList()
         fileAdapter.submitList(files)
+        scanRoms(files.filter { it.isFile })
+    }
+
+    private fun scanRoms(roms: List<File>) {
+        // Only the latest listing's results are wanted
+        val generation = ++scanGeneration
+        if (roms.isEmpty()) {
+            fileAdapter.romInfo = emptyMap()
+            return
+        }
+        val index = filesDir.resolve(ROM_INDEX)
+        Thread {
+            val info = RomLibrary.scan(roms, index)
+            val romInfo = roms.indices.associate { roms[it] to info[it] }
+            runOnUiThread {
+                if (generation == scanGeneration) {
+                    fileAdapter.romInfo = romInfo
+                }
+            }
+        }.start()
     }
 
     private fun toggleSelection(file: File) {
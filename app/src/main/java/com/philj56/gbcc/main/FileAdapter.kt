@@ -19,6 +19,13 @@ class FileAdapter(
 
     val selected = HashSet<File>()
 
+    // Cartridge headers from RomLibrary.scan, null for files that aren't ROMs
+    var romInfo: Map<File, RomInfo?> = emptyMap()
+        set(value) {
+            field = value
+            notifyItemRangeChanged(0, itemCount)
+        }
+
     class FileViewHolder(itemView: View, private val adapter: FileAdapter, val onClick: (File, View) -> Unit, val onLongClick: (File, View) -> Unit) :
         RecyclerView.ViewHolder(itemView) {
         private val textView = itemView.findViewById<TextView>(R.id.fileEntry)
@@ -42,7 +49,14 @@ class FileAdapter(
         fun bind(file: File) {
             currentFile = file
             itemView.isActivated = file in adapter.selected
-            when (file.extension) {
+            // Go by the header once it's been scanned, as extensions can lie
+            val info = adapter.romInfo[file]
+            val extension = when {
+                info == null -> file.extension
+                info.cgb -> "gbc"
+                else -> "gb"
+            }
+            when (extension) {
                 "gbc" -> {
                     imageView.setImageResource(R.drawable.ic_file_gbc)
                     imageView.clearColorFilter()
@@ -0,0 +1,46 @@
+package com.philj56.gbcc.main
+
+import java.io.File
+
+data class RomInfo(
+    val title: String,
+    val mbc: String,
+    val cgb: Boolean,
+    val cgbOnly: Boolean,
+    val sgb: Boolean,
+    val romSize: Int,
+    val ramSize: Int,
+    val features: Int
+) {
+    fun hasFeature(feature: Int): Boolean = (features and feature) != 0
+
+    companion object {
+        // Must match ROM_FEATURE_* in rom_header.h
+        const val FEATURE_RAM = 1 shl 0
+        const val FEATURE_BATTERY = 1 shl 1
+        const val FEATURE_TIMER = 1 shl 2
+        const val FEATURE_RUMBLE = 1 shl 3
+        const val FEATURE_ACCELEROMETER = 1 shl 4
+        const val FEATURE_CAMERA = 1 shl 5
+    }
+}
+
+object RomLibrary {
+    init {
+        System.loadLibrary("gbcc")
+    }
+
+    /**
+     * Read the cartridge headers of [files] in parallel, returning null for
+     * anything that isn't a valid ROM. Results are cached in [index] by path,
+     * size & modification time, so rescans only open changed files.
+     *
+     * This blocks on file IO, so shouldn't be called from the UI thread.
+     */
+    fun scan(files: List<File>, index: File): Array<RomInfo?> {
+        return scan(Array(files.size) { files[it].absolutePath }, index.absolutePath)
+    }
+
+    @JvmStatic
+    private external fun scan(files: Array<String>, indexFile: String): Array<RomInfo?>
+}